@@ -1,70 +1,209 @@
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "simp.h"
 
-#define SYMTAB_SIZE     389
-#define SYMTAB_MULT     37
+/* initial number of slots of the symbol table (a power of two) */
+#define SYMTAB_SIZE     512
+
+/* number of symbols interned between collections which are logged */
+#define YOUNG_SIZE      1024
+
+/*
+ * The type of an object is kept in the low bits of its meta field.
+ * The other bits hold the bound arguments of a builtin (heap objects
+ * are aligned to 16 bytes), or the address of the source location of
+ * any other object (null if it has none; locations are 16 bytes long
+ * and aligned like heap objects).
+ */
+#define TYPEBITS        ((uintptr_t)0xF)
+#define METAOF(obj)     ((Heap *)((obj).meta & ~TYPEBITS))
+#define TYPEOF(obj)     ((Type)((obj).meta & TYPEBITS))
+
+/*
+ * Size in bytes of the first table of source locations of a form, and
+ * of the largest one (each is a size class of the collector).
+ */
+#define SOURCES_MIN     256
+#define SOURCES_MAX     4096
+
+/* slices are indexed by 32 bits */
+#define MAXSIZE         UINT_MAX
+
+/* initial number of bindings of a frame */
+#define FRAME_SIZE      1
+
+/* flags of a symbol, kept in the byte after its name */
+#define SYMBOL_SYNTAX   0x01    /* it has been bound in a syntax frame */
+#define SYMBOL_LOCAL    0x02    /* it has been bound out of a global frame */
+#define SYMBOL_SYNLOCAL 0x04    /* it has been bound out of a global syntax frame */
 
 enum {
 	/*
-	 * An environment frame is a linked-list of triplets containing
-	 * a symbol of the variable, its value, and a pointer to the
-	 * next triplet.
+	 * An environment frame is a vector of bindings, each a pair of
+	 * the symbol of the variable and its value.  The vector may have
+	 * room for more bindings than it holds: its size covers only the
+	 * bindings, and a new binding is appended to it (or to a copy
+	 * twice as large, when it is full).  A binding is never removed
+	 * nor moved to another position in its frame.
 	 */
 	BINDING_VARIABLE,
 	BINDING_VALUE,
-	BINDING_NEXT,
 	BINDING_SIZE,
 };
 
 enum {
 	/*
-	 * An environment is a pair of a pointer to its parent and a
-	 * pointer to the environment's frame
+	 * An environment is a triplet of a pointer to its parent, its
+	 * frame, and its frame of syntax bindings.
+	 *
+	 * An environment with no parent is global: its frame also has an
+	 * index, an opaque open-addressed table of the positions (plus
+	 * one; zero for free slots) of its bindings, hashed from the
+	 * address of their symbols.  The index has two slots for each
+	 * binding the frame has room for, and is remade when the frame
+	 * grows.  Global bindings are thereby found without a scan, and
+	 * the value slot of a global binding is a cell which can be
+	 * cached by its address, until the frame grows.
 	 */
 	ENVIRONMENT_PARENT,
 	ENVIRONMENT_FRAME,
 	ENVIRONMENT_SYNFRAME,
 	ENVIRONMENT_SIZE,
+	ENVIRONMENT_INDEX = ENVIRONMENT_SIZE,
+	GLOBAL_SIZE,
 };
 
 enum {
+	/*
+	 * A context holds the symbol table and the table of source
+	 * locations (or false, if they are not tracked).
+	 *
+	 * The symbol table is open-addressed with linear probing: a
+	 * vector of symbols (nil for free slots), and an opaque array
+	 * of their hashes, which are compared before the names.  It is
+	 * kept at most half full, so a symbol is usually found (or
+	 * known to be missing) with one probe.  The hashes are seeded
+	 * per context, so the probe sequences cannot be predicted.
+	 *
+	 * The symbol table is weak: the collector does not traverse the
+	 * vector of symbols, and removes the symbols it has not marked
+	 * before sweeping.  A minor collection only looks up the symbols
+	 * logged as interned since the last collection (unless the log
+	 * overflowed), since older symbols cannot be freed by it.
+	 * Symbols whose name is referenced from C (the filenames of
+	 * ports) are pinned in a list.
+	 *
+	 * A context also holds its global environment (the first one
+	 * made with no parent), and the version of the cells of global
+	 * bindings.  The version changes whenever a cached cell may have
+	 * become invalid: when a global frame grows (and its cells move),
+	 * when a symbol is first bound in a syntax frame or out of the
+	 * global frame (and may shadow its global binding), and when
+	 * anything is bound in a syntax frame out of the global one (and
+	 * may shadow a global macro).  It is negative once a second
+	 * environment with no parent is made, as cells are then not
+	 * cached at all.
+	 *
+	 * The syntax version changes whenever a syntax binding is made
+	 * or changed, and when a second environment with no parent is
+	 * made: code compiled for an older syntax version may treat as
+	 * a procedure call what is now a macro call, or the other way.
+	 */
+	CONTEXT_SYMBOLS,
+	CONTEXT_HASHES,
+	CONTEXT_NSYMBOLS,
+	CONTEXT_SEED,
+	CONTEXT_YOUNG,
+	CONTEXT_PINNED,
+	CONTEXT_SOURCES,
+	CONTEXT_GLOBAL,
+	CONTEXT_VERSION,
+	CONTEXT_SYNVERSION,
+	CONTEXT_SIZE,
+};
+
+enum {
+	/*
+	 * A closure is its environment, the vector of the symbols of its
+	 * parameters, whether the last parameter takes the remaining
+	 * arguments, its body, and the code compiled from its body (or
+	 * false, if it has not been compiled yet).
+	 */
 	CLOSURE_ENVIRONMENT,
 	CLOSURE_PARAMETERS,
 	CLOSURE_VARARGS,
 	CLOSURE_EXPRESSIONS,
+	CLOSURE_CODE,
 	CLOSURE_SIZE
 };
 
 struct Source {
 	const char             *filename;
-	SimpSiz                 lineno;
-	SimpSiz                 column;
+	unsigned int            lineno;
+	unsigned int            column;
 };
 
-static Simp *
-getbind(Simp obj)
+struct Young {
+	SimpSiz                 nsymbols;
+	struct {
+		Heap           *heap;
+		uint32_t        hash;
+	} symbols[YOUNG_SIZE];
+};
+
+struct Sources {
+	/*
+	 * Source locations of the objects read from a top-level form of
+	 * the program source, whose meta fields point to their entries,
+	 * so a location costs no heap object of its own.  A form whose
+	 * locations do not fit gets another, larger table.  A table is
+	 * freed by the collector once no object points into it.  Data
+	 * read at run time are not recorded.
+	 */
+	SimpSiz                 nsources;
+	SimpSiz                 maxsources;
+	struct Source           sources[];
+};
+
+static Simp
+opaque(Heap *heap)
 {
-	return simp_getvector(obj);
+	/* raw arrays are not values; they are kept as opaque strings */
+	return (Simp){
+		.meta = TYPE_STRING,
+		.u.heap = heap,
+		.size = 0,
+		.start = 0,
+	};
 }
 
-Simp
-simp_getbindvariable(Simp obj)
+SimpSiz
+simp_getframesize(Simp frame)
 {
-	return getbind(obj)[BINDING_VARIABLE];
+	return simp_getsize(frame) / BINDING_SIZE;
 }
 
 Simp
-simp_getbindvalue(Simp obj)
+simp_getframevariable(Simp frame, SimpSiz pos)
 {
-	return getbind(obj)[BINDING_VALUE];
+	return simp_getvector(frame)[pos * BINDING_SIZE + BINDING_VARIABLE];
 }
 
 Simp
-simp_getnextbind(Simp obj)
+simp_getframevalue(Simp frame, SimpSiz pos)
+{
+	return simp_getvector(frame)[pos * BINDING_SIZE + BINDING_VALUE];
+}
+
+Simp *
+simp_getframecell(Simp frame, SimpSiz pos)
 {
-	return getbind(obj)[BINDING_NEXT];
+	return &simp_getvector(frame)[pos * BINDING_SIZE + BINDING_VALUE];
 }
 
 Simp *
@@ -84,54 +223,602 @@ simp_getclosure(Simp obj)
 enum Type
 simp_gettype(Simp obj)
 {
-	return obj.type;
+	return TYPEOF(obj);
 }
 
-bool
-simp_envredefine(Simp env, Simp var, Simp val, bool syntax)
+static void
+settype(Simp *obj, Type type)
 {
-	Simp bind, sym;
+	obj->meta = (uintptr_t)METAOF(*obj) | type;
+}
 
-	if (syntax)
-		bind = simp_getenvsynframe(env);
-	else
-		bind = simp_getenvframe(env);
-	for (; !simp_isnil(bind); bind = simp_getnextbind(bind)) {
-		sym = simp_getbindvariable(bind);
-		if (simp_issame(var, sym)) {
-			simp_setvector(bind, BINDING_VALUE, val);
+static bool
+newvector(Simp ctx, Simp *ret, SimpSiz size, Type type)
+{
+	SimpSiz i;
+	Simp *data;
+	Heap *heap;
+
+	*ret = simp_nil();
+	if (size == 0)
+		return true;
+	if (size > MAXSIZE)
+		return false;
+	heap = simp_gcnewobj(
+		simp_getgcmemory(ctx),
+		type,
+		size * sizeof(Simp),
+		size
+	);
+	if (heap == NULL)
+		return false;
+	data = simp_getheapdata(heap);
+	for (i = 0; i < size; i++)
+		data[i] = simp_nil();
+	ret->u.heap = heap;
+	ret->size = size;
+	return true;
+}
+
+static bool
+isglobal(Simp env)
+{
+	return simp_getsize(env) > ENVIRONMENT_INDEX;
+}
+
+static uint32_t *
+getindex(Simp env)
+{
+	Simp index;
+
+	if (!isglobal(env))
+		return NULL;
+	index = simp_getvectormemb(env, ENVIRONMENT_INDEX);
+	if (simp_isnil(index))
+		return NULL;
+	return simp_getheapdata(index.u.heap);
+}
+
+static SimpSiz
+hashvar(Simp var)
+{
+	uintptr_t h;
+
+	h = (uintptr_t)simp_getsymbol(var);
+	h *= (uintptr_t)0x9E3779B97F4A7C15;
+	return h >> (sizeof(h) * CHAR_BIT / 2);
+}
+
+static void
+indexbinding(uint32_t *index, SimpSiz mask, Simp var, SimpSiz pos)
+{
+	SimpSiz i;
+
+	for (i = hashvar(var) & mask; index[i] != 0; i = (i + 1) & mask)
+		;
+	index[i] = pos + 1;
+}
+
+static bool
+newindex(Simp ctx, Simp env, Simp frame)
+{
+	Heap *heap;
+	uint32_t *index;
+	SimpSiz i, n, size;
+
+	size = simp_getheapsize(simp_getgcmemory(frame)) / BINDING_SIZE * 2;
+	heap = simp_gcnewobj(simp_getgcmemory(ctx), TYPE_VOID, size * sizeof(*index), 0);
+	if (heap == NULL)
+		return false;
+	index = simp_getheapdata(heap);
+	memset(index, 0, size * sizeof(*index));
+	n = simp_getframesize(frame);
+	for (i = 0; i < n; i++)
+		if (simp_issymbol(simp_getframevariable(frame, i)))
+			indexbinding(index, size - 1, simp_getframevariable(frame, i), i);
+	simp_setvector(ctx, env, ENVIRONMENT_INDEX, opaque(heap));
+	return true;
+}
+
+static bool
+findbinding(Simp frame, uint32_t *index, Simp var, SimpSiz *pos)
+{
+	SimpSiz i, n, mask;
+
+	n = simp_getframesize(frame);
+	if (n == 0)
+		return false;
+	if (index != NULL && simp_issymbol(var)) {
+		mask = simp_getheapsize(simp_getgcmemory(frame)) / BINDING_SIZE * 2 - 1;
+		for (i = hashvar(var) & mask; index[i] != 0; i = (i + 1) & mask) {
+			if (simp_issame(var, simp_getframevariable(frame, index[i] - 1))) {
+				*pos = index[i] - 1;
+				return true;
+			}
+		}
+		return false;
+	}
+	for (i = 0; i < n; i++) {
+		if (simp_issame(var, simp_getframevariable(frame, i))) {
+			*pos = i;
 			return true;
 		}
 	}
 	return false;
 }
 
+static void
+newversion(Simp ctx)
+{
+	SimpInt version;
+
+	version = simp_contextversion(ctx);
+	if (version >= 0)
+		(void)simp_makesignum(ctx, &simp_getvector(ctx)[CONTEXT_VERSION], version + 1);
+}
+
+static void
+newsynversion(Simp ctx)
+{
+	SimpInt version;
+
+	version = simp_contextsynversion(ctx);
+	(void)simp_makesignum(ctx, &simp_getvector(ctx)[CONTEXT_SYNVERSION], version + 1);
+}
+
+SimpInt
+simp_contextversion(Simp ctx)
+{
+	return simp_getsignum(simp_getvectormemb(ctx, CONTEXT_VERSION));
+}
+
+SimpInt
+simp_contextsynversion(Simp ctx)
+{
+	return simp_getsignum(simp_getvectormemb(ctx, CONTEXT_SYNVERSION));
+}
+
+Simp
+simp_contextenv(Simp ctx)
+{
+	return simp_getvectormemb(ctx, CONTEXT_GLOBAL);
+}
+
+bool
+simp_envfind(Simp env, Simp var, SimpSiz *pos)
+{
+	return findbinding(simp_getenvframe(env), getindex(env), var, pos);
+}
+
+bool
+simp_envredefine(Simp ctx, Simp env, Simp var, Simp val, bool syntax)
+{
+	Simp frame;
+	uint32_t *index;
+	SimpSiz i;
+
+	if (syntax) {
+		frame = simp_getenvsynframe(env);
+		index = NULL;
+	} else {
+		frame = simp_getenvframe(env);
+		index = getindex(env);
+	}
+	if (!findbinding(frame, index, var, &i))
+		return false;
+	simp_setvector(ctx, frame, i * BINDING_SIZE + BINDING_VALUE, val);
+	if (syntax)
+		newsynversion(ctx);
+	return true;
+}
+
+static void
+flagvariable(Simp ctx, Simp var, unsigned char flag)
+{
+	unsigned char *flags;
+
+	if (!simp_issymbol(var))
+		return;
+	flags = &simp_getsymbol(var)[simp_getsize(var)];
+	if (flag & ~*flags) {
+		*flags |= flag;
+		newversion(ctx);
+	}
+}
+
+bool
+simp_envbind(Simp ctx, Simp env, Simp vars, const Simp *vals, SimpSiz nvals, bool variadic, SimpSiz nspare)
+{
+	Simp frame, val;
+	SimpSiz i, j, n;
+
+	/*
+	 * Bind each variable to the value at its position (or the last
+	 * one to a vector of the remaining values, if variadic) in one
+	 * step, into an environment with no binding yet; its frame is
+	 * made at once at its final size, with room for nspare more
+	 * bindings to be defined in it without growing.
+	 */
+	n = simp_getsize(vars);
+	if (n == 0)
+		return true;
+	if (!isglobal(env)) {
+		if (!simp_makevector(ctx, &frame, (n + nspare) * BINDING_SIZE))
+			return false;
+		frame = simp_slicevector(frame, 0, n * BINDING_SIZE);
+	}
+	for (i = 0; i < n; i++) {
+		if (variadic && i + 1 == n) {
+			if (!simp_makevector(ctx, &val, nvals - i))
+				return false;
+			for (j = i; j < nvals; j++)
+				simp_setvector(ctx, val, j - i, vals[j]);
+		} else {
+			val = vals[i];
+		}
+		if (isglobal(env)) {
+			if (!simp_envdefine(ctx, env, simp_getvectormemb(vars, i), val, false))
+				return false;
+			continue;
+		}
+		simp_setvector(ctx, frame, i * BINDING_SIZE + BINDING_VARIABLE, simp_getvectormemb(vars, i));
+		simp_setvector(ctx, frame, i * BINDING_SIZE + BINDING_VALUE, val);
+		flagvariable(ctx, simp_getvectormemb(vars, i), SYMBOL_LOCAL);
+	}
+	if (!isglobal(env))
+		simp_setvector(ctx, env, ENVIRONMENT_FRAME, frame);
+	return true;
+}
+
+bool
+simp_envrebind(Simp ctx, Simp env, Simp vars, const Simp *vals, SimpSiz nvals)
+{
+	Simp frame;
+	SimpSiz i;
+
+	/*
+	 * Bind each variable again to the value at its position, in place,
+	 * in an environment whose frame begins with the bindings of those
+	 * variables; the bindings defined after them, and the syntax
+	 * bindings, are dropped, as if the environment were new.  Return
+	 * false, changing nothing, if the frame does not begin so.
+	 */
+	if (isglobal(env))
+		return false;
+	frame = simp_getenvframe(env);
+	if (simp_getsize(vars) != nvals || simp_getsize(frame) < nvals * BINDING_SIZE)
+		return false;
+	for (i = 0; i < nvals; i++)
+		if (!simp_issame(simp_getframevariable(frame, i), simp_getvectormemb(vars, i)))
+			return false;
+	frame = simp_slicevector(frame, 0, nvals * BINDING_SIZE);
+	for (i = 0; i < nvals; i++)
+		simp_setvector(ctx, frame, i * BINDING_SIZE + BINDING_VALUE, vals[i]);
+	simp_setvector(ctx, env, ENVIRONMENT_FRAME, frame);
+	simp_setvector(ctx, env, ENVIRONMENT_SYNFRAME, simp_nil());
+	return true;
+}
+
 bool
 simp_envdefine(Simp ctx, Simp env, Simp var, Simp val, bool syntax)
 {
-	Simp frame, bind;
+	Simp frame, newframe;
+	SimpSiz size, capacity;
+	unsigned char flag;
+	bool indexed;
 	int memb;
 
 	if (syntax) {
 		frame = simp_getenvsynframe(env);
 		memb = ENVIRONMENT_SYNFRAME;
+		flag = SYMBOL_SYNTAX;
 	} else {
 		frame = simp_getenvframe(env);
 		memb = ENVIRONMENT_FRAME;
+		flag = isglobal(env) ? 0 : SYMBOL_LOCAL;
+	}
+	indexed = !syntax && isglobal(env);
+	size = simp_getsize(frame);
+	capacity = 0;
+	if (!simp_isnil(frame))
+		capacity = simp_getheapsize(simp_getgcmemory(frame));
+	if (size + BINDING_SIZE > capacity) {
+		if (capacity == 0)
+			capacity = FRAME_SIZE * BINDING_SIZE;
+		else
+			capacity *= 2;
+		if (!simp_makevector(ctx, &newframe, capacity))
+			return false;
+		if (size > 0)
+			simp_cpyvector(ctx, newframe, frame);
+		frame = newframe;
+		if (indexed && !newindex(ctx, env, frame))
+			return false;
+		if (isglobal(env))
+			newversion(ctx);
 	}
-	if (!simp_makevector(ctx, &bind, BINDING_SIZE))
+	frame = simp_slicevector(frame, 0, size + BINDING_SIZE);
+	simp_setvector(ctx, frame, size + BINDING_VARIABLE, var);
+	simp_setvector(ctx, frame, size + BINDING_VALUE, val);
+	simp_setvector(ctx, env, memb, frame);
+	if (indexed && simp_issymbol(var)) {
+		indexbinding(
+			getindex(env),
+			capacity / BINDING_SIZE * 2 - 1,
+			var, size / BINDING_SIZE
+		);
+	}
+	flagvariable(ctx, var, flag);
+	if (syntax && !isglobal(env)) {
+		flagvariable(ctx, var, SYMBOL_SYNLOCAL);
+		newversion(ctx);
+	}
+	if (syntax)
+		newsynversion(ctx);
+	return true;
+}
+
+bool
+simp_issyntax(Simp sym)
+{
+	return simp_getsymbol(sym)[simp_getsize(sym)] & SYMBOL_SYNTAX;
+}
+
+bool
+simp_islocal(Simp sym)
+{
+	return simp_getsymbol(sym)[simp_getsize(sym)] & SYMBOL_LOCAL;
+}
+
+bool
+simp_islocalsyntax(Simp sym)
+{
+	return simp_getsymbol(sym)[simp_getsize(sym)] & SYMBOL_SYNLOCAL;
+}
+
+static uint32_t *
+gethashes(Simp ctx)
+{
+	return simp_getheapdata(simp_getvectormemb(ctx, CONTEXT_HASHES).u.heap);
+}
+
+static SimpSiz
+getnsymbols(Simp ctx)
+{
+	return simp_getsignum(simp_getvectormemb(ctx, CONTEXT_NSYMBOLS));
+}
+
+static uint64_t
+hash(uint64_t seed, const unsigned char *s, SimpSiz size)
+{
+	uint64_t h;
+	SimpSiz i;
+
+	/* FNV-1a from the seed, then the finalizer of MurmurHash3 */
+	h = seed ^ 0xcbf29ce484222325;
+	for (i = 0; i < size; i++) {
+		h ^= s[i];
+		h *= 0x100000001b3;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccd;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53;
+	h ^= h >> 33;
+	return h;
+}
+
+static struct Young *
+getyoung(Simp ctx)
+{
+	return simp_getheapdata(simp_getvectormemb(ctx, CONTEXT_YOUNG).u.heap);
+}
+
+static bool
+newsymtab(Simp ctx, SimpSiz size)
+{
+	Simp oldsyms, syms;
+	Simp *slots;
+	Heap *heap;
+	uint32_t *oldhashes, *hashes;
+	SimpSiz i, j, oldsize;
+
+	/* the vector is made with no traversable members, so it is weak */
+	heap = simp_gcnewobj(simp_getgcmemory(ctx), TYPE_VECTOR, size * sizeof(Simp), 0);
+	if (heap == NULL)
+		return false;
+	slots = simp_getheapdata(heap);
+	for (i = 0; i < size; i++)
+		slots[i] = simp_nil();
+	syms = (Simp){
+		.meta = TYPE_VECTOR,
+		.u.heap = heap,
+		.size = size,
+		.start = 0,
+	};
+	heap = simp_gcnewobj(simp_getgcmemory(ctx), TYPE_VOID, size * sizeof(*hashes), 0);
+	if (heap == NULL)
 		return false;
-	simp_setvector(bind, BINDING_VARIABLE, var);
-	simp_setvector(bind, BINDING_VALUE, val);
-	simp_setvector(bind, BINDING_NEXT, frame);
-	simp_setvector(env, memb, bind);
+	hashes = simp_getheapdata(heap);
+	oldsyms = simp_getvectormemb(ctx, CONTEXT_SYMBOLS);
+	oldsize = simp_getsize(oldsyms);
+	oldhashes = oldsize > 0 ? gethashes(ctx) : NULL;
+	for (i = 0; i < oldsize; i++) {
+		if (simp_isnil(simp_getvectormemb(oldsyms, i)))
+			continue;
+		j = oldhashes[i] & (size - 1);
+		while (!simp_isnil(slots[j]))
+			j = (j + 1) & (size - 1);
+		slots[j] = simp_getvectormemb(oldsyms, i);
+		hashes[j] = oldhashes[i];
+	}
+	simp_setvector(ctx, ctx, CONTEXT_SYMBOLS, syms);
+	simp_setvector(ctx, ctx, CONTEXT_HASHES, opaque(heap));
 	return true;
 }
 
 bool
 simp_contextnew(Simp *ctx)
 {
-	return simp_makevector(simp_nil(), ctx, SYMTAB_SIZE);
+	Simp seed, zero;
+	Heap *heap;
+
+	if (!simp_makevector(simp_nil(), ctx, CONTEXT_SIZE))
+		return false;
+	(void)simp_makesignum(
+		*ctx, &seed,
+		(SimpInt)time(NULL) ^ (SimpInt)getpid() << 32 ^
+		(SimpInt)(uintptr_t)simp_getgcmemory(*ctx)
+	);
+	simp_setvector(*ctx, *ctx, CONTEXT_SEED, seed);
+	(void)simp_makesignum(*ctx, &zero, 0);
+	simp_setvector(*ctx, *ctx, CONTEXT_NSYMBOLS, zero);
+	simp_setvector(*ctx, *ctx, CONTEXT_VERSION, zero);
+	simp_setvector(*ctx, *ctx, CONTEXT_SYNVERSION, zero);
+	heap = simp_gcnewobj(simp_getgcmemory(*ctx), TYPE_VOID, sizeof(struct Young), 0);
+	if (heap == NULL || !newsymtab(*ctx, SYMTAB_SIZE)) {
+		simp_gcfree(*ctx);
+		return false;
+	}
+	((struct Young *)simp_getheapdata(heap))->nsymbols = 0;
+	simp_setvector(*ctx, *ctx, CONTEXT_YOUNG, opaque(heap));
+	return true;
+}
+
+static void
+unintern(Simp *slots, uint32_t *hashes, SimpSiz mask, SimpSiz i)
+{
+	SimpSiz j, k;
+
+	/*
+	 * Fill the freed slot with the next symbol of the probe
+	 * sequence that can be moved back, until a free slot is found.
+	 * A symbol cannot be moved before its home slot.
+	 */
+	for (j = i;;) {
+		j = (j + 1) & mask;
+		if (simp_isnil(slots[j]))
+			break;
+		k = hashes[j] & mask;
+		if (i <= j ? i < k && k <= j : i < k || k <= j)
+			continue;
+		slots[i] = slots[j];
+		hashes[i] = hashes[j];
+		i = j;
+	}
+	slots[i] = simp_nil();
+}
+
+void
+simp_contextprune(Heap *heap, bool (*isalive)(Heap *), bool major)
+{
+	Simp ctx, syms;
+	Simp *slots;
+	struct Young *young;
+	uint32_t *hashes;
+	SimpSiz i, n, mask, nsymbols;
+
+	ctx = (Simp){
+		.meta = TYPE_VECTOR,
+		.u.heap = heap,
+		.size = CONTEXT_SIZE,
+		.start = 0,
+	};
+	syms = simp_getvectormemb(ctx, CONTEXT_SYMBOLS);
+	slots = simp_getvector(syms);
+	hashes = gethashes(ctx);
+	young = getyoung(ctx);
+	mask = simp_getsize(syms) - 1;
+	nsymbols = getnsymbols(ctx);
+	if (!major && young->nsymbols <= YOUNG_SIZE) {
+		for (n = 0; n < young->nsymbols; n++) {
+			if (isalive(young->symbols[n].heap))
+				continue;
+			i = young->symbols[n].hash & mask;
+			while (slots[i].u.heap != young->symbols[n].heap)
+				i = (i + 1) & mask;
+			unintern(slots, hashes, mask, i);
+			nsymbols--;
+		}
+	} else {
+		/*
+		 * Begin after a free slot, so symbols moved back by the
+		 * removal of another are not moved into visited slots.
+		 */
+		for (i = 0; !simp_isnil(slots[i]); i++)
+			;
+		for (n = 0; n <= mask; ) {
+			i = (i + 1) & mask;
+			n++;
+			if (simp_isnil(slots[i]))
+				continue;
+			if (isalive(slots[i].u.heap))
+				continue;
+			unintern(slots, hashes, mask, i);
+			nsymbols--;
+
+			/* visit again the slot, which may hold a moved symbol */
+			i = (i - 1) & mask;
+			n--;
+		}
+	}
+	young->nsymbols = 0;
+
+	/* a signum refers to no object, so it needs no write barrier */
+	(void)simp_makesignum(ctx, &simp_getvector(ctx)[CONTEXT_NSYMBOLS], nsymbols);
+}
+
+bool
+simp_pinsymbol(Simp ctx, Simp sym)
+{
+	Simp pinned, pair;
+
+	pinned = simp_getvectormemb(ctx, CONTEXT_PINNED);
+	for (pair = pinned; !simp_isnil(pair); pair = simp_getvectormemb(pair, 1))
+		if (simp_issame(simp_getvectormemb(pair, 0), sym))
+			return true;
+	if (!simp_makevector(ctx, &pair, 2))
+		return false;
+	simp_setvector(ctx, pair, 0, sym);
+	simp_setvector(ctx, pair, 1, pinned);
+	simp_setvector(ctx, ctx, CONTEXT_PINNED, pair);
+	return true;
+}
+
+void
+simp_contextsetsource(Simp ctx, bool track)
+{
+	simp_setvector(
+		ctx, ctx, CONTEXT_SOURCES,
+		track ? simp_nil() : simp_false()
+	);
+}
+
+void
+simp_contextstats(Simp ctx, SimpStats *stats)
+{
+	Simp syms;
+	uint32_t *hashes;
+	SimpSiz i, size, len;
+
+	syms = simp_getvectormemb(ctx, CONTEXT_SYMBOLS);
+	hashes = gethashes(ctx);
+	size = simp_getsize(syms);
+	stats->nsymbols = getnsymbols(ctx);
+	stats->nbuckets = size;
+	stats->maxbucket = 0;
+	for (i = 0; i < SIMP_NLOADS; i++)
+		stats->loads[i] = 0;
+	for (i = 0; i < size; i++) {
+		if (simp_isnil(simp_getvectormemb(syms, i)))
+			continue;
+
+		/* number of probes to find the symbol */
+		len = ((i - hashes[i]) & (size - 1)) + 1;
+		if (len > stats->maxbucket)
+			stats->maxbucket = len;
+		stats->loads[len <= SIMP_NLOADS ? len - 1 : SIMP_NLOADS - 1]++;
+	}
 }
 
 void
@@ -145,20 +832,26 @@ simp_cpystring(Simp dst, Simp src)
 }
 
 void
-simp_cpyvector(Simp dst, Simp src)
+simp_cpyvector(Simp ctx, Simp dst, Simp src)
 {
+	SimpSiz i, size;
+
+	size = simp_getsize(src);
 	(void)memcpy(
 		simp_getvector(dst),
 		simp_getvector(src),
-		simp_getsize(src) * sizeof(Simp)
+		size * sizeof(Simp)
 	);
+	for (i = 0; i < size; i++) {
+		simp_gcbarrier(ctx, dst, i, simp_getvectormemb(src, i));
+	}
 }
 
 Simp
 simp_empty(void)
 {
 	return (Simp){
-		.type = TYPE_STRING,
+		.meta = TYPE_STRING,
 		.u.heap = NULL,
 		.size = 0,
 		.start = 0,
@@ -168,13 +861,13 @@ simp_empty(void)
 Simp
 simp_eof(void)
 {
-	return (Simp){ .type = TYPE_EOF };
+	return (Simp){ .meta = TYPE_EOF };
 }
 
 Simp
 simp_false(void)
 {
-	return (Simp){ .type = TYPE_FALSE };
+	return (Simp){ .meta = TYPE_FALSE };
 }
 
 Builtin *
@@ -187,11 +880,10 @@ Simp
 simp_getbuiltinargs(Simp obj)
 {
 	return (Simp){
-		.type = TYPE_VECTOR,
-		.u.heap = obj.meta,
+		.meta = TYPE_VECTOR,
+		.u.heap = METAOF(obj),
 		.size = obj.size,
 		.start = 0,
-		.meta = NULL,
 	};
 }
 
@@ -208,7 +900,7 @@ simp_getclosureenv(Simp obj)
 }
 
 Simp
-simp_getclosureparam(Simp obj)
+simp_getclosureparams(Simp obj)
 {
 	return simp_getclosure(obj)[CLOSURE_PARAMETERS];
 }
@@ -225,6 +917,18 @@ simp_getclosurebody(Simp obj)
 	return simp_getclosure(obj)[CLOSURE_EXPRESSIONS];
 }
 
+Simp
+simp_getclosurecode(Simp obj)
+{
+	return simp_getclosure(obj)[CLOSURE_CODE];
+}
+
+void
+simp_setclosurecode(Simp ctx, Simp obj, Simp code)
+{
+	simp_setvector(ctx, obj, CLOSURE_CODE, code);
+}
+
 static Simp *
 simp_getenvironment(Simp obj)
 {
@@ -360,11 +1064,7 @@ simp_isnil(Simp obj)
 {
 	if (!simp_isvector(obj))
 		return false;
-	if (simp_getgcmemory(obj) == NULL)
-		return true;
-	if (simp_getheapdata(obj.u.heap) == NULL)
-		return true;
-	return false;
+	return simp_getgcmemory(obj) == NULL;
 }
 
 bool
@@ -480,9 +1180,10 @@ simp_setstring(Simp obj, SimpSiz pos, unsigned char u)
 }
 
 void
-simp_setvector(Simp obj, SimpSiz pos, Simp val)
+simp_setvector(Simp ctx, Simp obj, SimpSiz pos, Simp val)
 {
 	simp_getvector(obj)[pos] = val;
+	simp_gcbarrier(ctx, obj, pos, val);
 }
 
 Simp
@@ -504,7 +1205,7 @@ simp_slicestring(Simp obj, SimpSiz from, SimpSiz size)
 Simp
 simp_true(void)
 {
-	return (Simp){ .type = TYPE_TRUE };
+	return (Simp){ .meta = TYPE_TRUE };
 }
 
 bool
@@ -512,9 +1213,8 @@ simp_makebuiltin(Simp ctx, Simp *ret, Simp args, Builtin *builtin)
 {
 	(void)ctx;
 	*ret = (Simp){
-		.type = TYPE_BUILTIN,
+		.meta = (uintptr_t)simp_getgcmemory(args) | TYPE_BUILTIN,
 		.u.builtin = builtin,
-		.meta = simp_getgcmemory(args),
 		.size = simp_getsize(args),
 	};
 	return true;
@@ -525,9 +1225,8 @@ simp_makebyte(Simp ctx, Simp *ret, unsigned char byte)
 {
 	(void)ctx;
 	*ret = (Simp){
-		.type = TYPE_BYTE,
+		.meta = TYPE_BYTE,
 		.u.byte = byte,
-		.meta = NULL,
 	};
 	return true;
 }
@@ -535,13 +1234,25 @@ simp_makebyte(Simp ctx, Simp *ret, unsigned char byte)
 bool
 simp_makeenvironment(Simp ctx, Simp *env, Simp parent)
 {
-	(void)ctx;
-	if (!simp_makevector(ctx, env, ENVIRONMENT_SIZE))
+	Simp version;
+	bool global;
+
+	global = simp_isnulenv(parent);
+	if (!newvector(ctx, env, global ? GLOBAL_SIZE : ENVIRONMENT_SIZE, TYPE_ENVIRONMENT))
 		return false;
-	simp_setvector(*env, ENVIRONMENT_PARENT, parent);
-	simp_setvector(*env, ENVIRONMENT_FRAME, simp_nil());
-	simp_setvector(*env, ENVIRONMENT_SYNFRAME, simp_nil());
-	env->type = TYPE_ENVIRONMENT;
+	simp_setvector(ctx, *env, ENVIRONMENT_PARENT, parent);
+	simp_setvector(ctx, *env, ENVIRONMENT_FRAME, simp_nil());
+	simp_setvector(ctx, *env, ENVIRONMENT_SYNFRAME, simp_nil());
+	settype(env, TYPE_ENVIRONMENT);
+	if (!global)
+		return true;
+	if (simp_isnil(simp_getvectormemb(ctx, CONTEXT_GLOBAL))) {
+		simp_setvector(ctx, ctx, CONTEXT_GLOBAL, *env);
+	} else {
+		(void)simp_makesignum(ctx, &version, -1);
+		simp_setvector(ctx, ctx, CONTEXT_VERSION, version);
+		newsynversion(ctx);
+	}
 	return true;
 }
 
@@ -550,9 +1261,8 @@ simp_makesignum(Simp ctx, Simp *ret, SimpInt n)
 {
 	(void)ctx;
 	*ret = (Simp){
-		.type = TYPE_SIGNUM,
+		.meta = TYPE_SIGNUM,
 		.u.num = n,
-		.meta = NULL,
 	};
 	return true;
 }
@@ -560,19 +1270,17 @@ simp_makesignum(Simp ctx, Simp *ret, SimpInt n)
 bool
 simp_makeclosure(Simp ctx, Simp *lambda, Simp src, Simp env, Simp params, Simp varargs, Simp body)
 {
-	const char *filename = NULL;
-	SimpSiz lineno = 0;
-	SimpSiz column = 0;
-
-	if (!simp_makevector(ctx, lambda, CLOSURE_SIZE))
+	if (!newvector(ctx, lambda, CLOSURE_SIZE, TYPE_CLOSURE))
 		return false;
-	simp_setvector(*lambda, CLOSURE_ENVIRONMENT, env);
-	simp_setvector(*lambda, CLOSURE_PARAMETERS, params);
-	simp_setvector(*lambda, CLOSURE_VARARGS, varargs);
-	simp_setvector(*lambda, CLOSURE_EXPRESSIONS, body);
-	lambda->type = TYPE_CLOSURE;
-	if (simp_getsource(src, &filename, &lineno, &column))
-		return simp_setsource(ctx, lambda, filename, lineno, column);
+	simp_setvector(ctx, *lambda, CLOSURE_ENVIRONMENT, env);
+	simp_setvector(ctx, *lambda, CLOSURE_PARAMETERS, params);
+	simp_setvector(ctx, *lambda, CLOSURE_VARARGS, varargs);
+	simp_setvector(ctx, *lambda, CLOSURE_EXPRESSIONS, body);
+	simp_setvector(ctx, *lambda, CLOSURE_CODE, simp_false());
+
+	/* a closure shares the source location of its lambda expression */
+	if (!simp_isbuiltin(src))
+		lambda->meta = (uintptr_t)METAOF(src) | TYPE_CLOSURE;
 	return true;
 }
 
@@ -581,10 +1289,9 @@ simp_makeport(Simp ctx, Simp *ret, Heap *p)
 {
 	(void)ctx;
 	*ret = (Simp){
-		.type = TYPE_PORT,
+		.meta = TYPE_PORT,
 		.size = 1,
 		.start = 0,
-		.meta = NULL,
 		.u.heap = p,
 	};
 	return true;
@@ -595,15 +1302,14 @@ simp_makereal(Simp ctx, Simp *ret, double x)
 {
 	(void)ctx;
 	*ret = (Simp){
-		.type = TYPE_REAL,
+		.meta = TYPE_REAL,
 		.u.real = x,
-		.meta = NULL,
 	};
 	return true;
 }
 
-bool
-simp_makestring(Simp ctx, Simp *ret, const unsigned char *src, SimpSiz size)
+static bool
+newstring(Simp ctx, Simp *ret, const unsigned char *src, SimpSiz size, Type type)
 {
 	Heap *heap;
 	unsigned char *dst = NULL;
@@ -611,90 +1317,103 @@ simp_makestring(Simp ctx, Simp *ret, const unsigned char *src, SimpSiz size)
 	*ret = simp_empty();
 	if (size == 0)
 		return true;
-	heap = simp_gcnewobj(simp_getgcmemory(ctx), size, 0);
+	if (size > MAXSIZE)
+		return false;
+	heap = simp_gcnewobj(simp_getgcmemory(ctx), type, size, 0);
 	if (heap == NULL)
 		return false;
 	dst = (unsigned char *)simp_getheapdata(heap);
 	if (src != NULL)
 		memcpy(dst, src, size);
 	*ret = (Simp){
-		.type = TYPE_STRING,
+		.meta = TYPE_STRING,
 		.size = size,
 		.start = 0,
 		.u.heap = heap,
-		.meta = NULL,
 	};
 	return true;
 }
 
 bool
-simp_makesymbol(Simp ctx, Simp *sym, const unsigned char *src, SimpSiz size)
+simp_makestring(Simp ctx, Simp *ret, const unsigned char *src, SimpSiz size)
 {
-	Simp list, prev, pair;
-	SimpSiz i, bucket, len;
-	unsigned char *dst;
+	return newstring(ctx, ret, src, size, TYPE_STRING);
+}
 
-	bucket = 0;
-	for (i = 0; i < size; i++) {
-		bucket *= SYMTAB_MULT;
-		bucket += src[i];
-	}
-	bucket %= SYMTAB_SIZE;
-	list = simp_getvectormemb(ctx, bucket);
-	prev = simp_nil();
-	for (pair = list; !simp_isnil(pair); pair = simp_getvectormemb(pair, 1)) {
-		*sym = simp_getvectormemb(pair, 0);
-		dst = simp_getstring(*sym);
-		len = simp_getsize(*sym);
-		if (len == size && memcmp(src, dst, size) == 0)
+bool
+simp_makesymbol(Simp ctx, Simp *sym, const unsigned char *src, SimpSiz size)
+{
+	Simp syms, num;
+	Simp *slots;
+	struct Young *young;
+	uint32_t *hashes, h;
+	SimpSiz i, mask, nslots, nsymbols;
+
+	h = hash(simp_getsignum(simp_getvectormemb(ctx, CONTEXT_SEED)), src, size);
+	syms = simp_getvectormemb(ctx, CONTEXT_SYMBOLS);
+	slots = simp_getvector(syms);
+	hashes = gethashes(ctx);
+	mask = simp_getsize(syms) - 1;
+	for (i = h & mask; !simp_isnil(slots[i]); i = (i + 1) & mask) {
+		if (hashes[i] != h || simp_getsize(slots[i]) != size)
+			continue;
+		if (memcmp(src, simp_getsymbol(slots[i]), size) == 0) {
+			*sym = slots[i];
 			return true;
-		prev = pair;
+		}
 	}
-	if (!simp_makestring(ctx, sym, src, size))
+	/* the name is followed by the flags of the symbol */
+	if (!newstring(ctx, sym, NULL, size + 1, TYPE_SYMBOL))
 		return false;
-	sym->type = TYPE_SYMBOL;
-	if (!simp_makevector(ctx, &pair, 2))
-		return false;
-	simp_setvector(pair, 0, *sym);
-	if (simp_isnil(prev))
-		simp_setvector(ctx, bucket, pair);
-	else
-		simp_setvector(prev, 1, pair);
+	if (size > 0)
+		memcpy(simp_getsymbol(*sym), src, size);
+	simp_getsymbol(*sym)[size] = 0;
+	sym->size = size;
+	settype(sym, TYPE_SYMBOL);
+	/*
+	 * Rehash into a quarter full table when the table becomes half
+	 * full, or (since symbols are removed by the collector) when it
+	 * becomes less than an eighth full.
+	 */
+	nsymbols = getnsymbols(ctx) + 1;
+	nslots = mask + 1;
+	if (nsymbols * 2 > nslots || (nslots > SYMTAB_SIZE && nsymbols * 8 < nslots)) {
+		for (nslots = SYMTAB_SIZE; nsymbols * 4 > nslots; nslots *= 2)
+			;
+		if (!newsymtab(ctx, nslots))
+			return false;
+		syms = simp_getvectormemb(ctx, CONTEXT_SYMBOLS);
+		slots = simp_getvector(syms);
+		hashes = gethashes(ctx);
+		mask = simp_getsize(syms) - 1;
+		for (i = h & mask; !simp_isnil(slots[i]); i = (i + 1) & mask)
+			;
+	}
+	simp_setvector(ctx, syms, i, *sym);
+	hashes[i] = h;
+	young = getyoung(ctx);
+	if (young->nsymbols < YOUNG_SIZE) {
+		young->symbols[young->nsymbols].heap = sym->u.heap;
+		young->symbols[young->nsymbols].hash = h;
+	}
+	if (young->nsymbols <= YOUNG_SIZE)
+		young->nsymbols++;
+	(void)simp_makesignum(ctx, &num, nsymbols);
+	simp_setvector(ctx, ctx, CONTEXT_NSYMBOLS, num);
 	return true;
 }
 
 bool
 simp_makevector(Simp ctx, Simp *ret, SimpSiz size)
 {
-	SimpSiz i;
-	Simp *data;
-	Heap *heap;
-
-	*ret = simp_nil();
-	if (size == 0)
-		return true;
-	heap = simp_gcnewobj(
-		simp_getgcmemory(ctx),
-		size * sizeof(Simp),
-		size
-	);
-	if (heap == NULL)
-		return false;
-	data = simp_getheapdata(heap);
-	for (i = 0; i < size; i++)
-		data[i] = simp_nil();
-	ret->type = TYPE_VECTOR;
-	ret->u.heap = heap;
-	ret->size = size;
-	ret->start = 0;
-	return true;
+	return newvector(ctx, ret, size, TYPE_VECTOR);
 }
 
 Simp
 simp_nil(void)
 {
 	return (Simp){
-		.type = TYPE_VECTOR,
+		.meta = TYPE_VECTOR,
 		.size = 0,
 		.start = 0,
 		.u.heap = NULL,
@@ -705,7 +1424,7 @@ Simp
 simp_nulenv(void)
 {
 	return (Simp){
-		.type = TYPE_ENVIRONMENT,
+		.meta = TYPE_ENVIRONMENT,
 		.size = 0,
 		.start = 0,
 		.u.heap = NULL,
@@ -715,7 +1434,7 @@ simp_nulenv(void)
 Simp
 simp_void(void)
 {
-	return (Simp){ .type = TYPE_VOID };
+	return (Simp){ .meta = TYPE_VOID };
 }
 
 Heap *
@@ -724,18 +1443,68 @@ simp_getgcmemory(Simp obj)
 	return obj.u.heap;
 }
 
+static struct Sources *
+getsources(Simp ctx)
+{
+	Simp table;
+
+	table = simp_getvectormemb(ctx, CONTEXT_SOURCES);
+	if (simp_isfalse(table) || simp_isnil(table))
+		return NULL;
+	return simp_getheapdata(table.u.heap);
+}
+
+static bool
+newsources(Simp ctx, struct Sources **sources)
+{
+	struct Sources *old = *sources;
+	Heap *heap;
+	SimpSiz size;
+
+	/*
+	 * Entries are not moved to the new table, as objects point
+	 * to them; the old table lives on as long as those objects.
+	 */
+	size = SOURCES_MIN;
+	if (old != NULL)
+		size = sizeof(*old) + old->maxsources * sizeof(old->sources[0]);
+	if (old != NULL && size < SOURCES_MAX)
+		size *= 2;
+	heap = simp_gcnewobj(simp_getgcmemory(ctx), TYPE_VOID, size, 0);
+	if (heap == NULL)
+		return false;
+	*sources = simp_getheapdata(heap);
+	(*sources)->nsources = 0;
+	(*sources)->maxsources = (size - sizeof(**sources)) / sizeof((*sources)->sources[0]);
+	simp_setvector(ctx, ctx, CONTEXT_SOURCES, opaque(heap));
+	return true;
+}
+
+void
+simp_newsources(Simp ctx)
+{
+	/* the locations of the next form go into a table of their own */
+	if (!simp_isfalse(simp_getvectormemb(ctx, CONTEXT_SOURCES)))
+		simp_setvector(ctx, ctx, CONTEXT_SOURCES, simp_nil());
+}
+
 bool
 simp_setsource(Simp ctx, Simp *obj, const char *filename, SimpSiz lineno, SimpSiz column)
 {
+	struct Sources *sources;
 	struct Source *src;
 
-	obj->meta = simp_gcnewobj(simp_getgcmemory(ctx), sizeof(*src), 0);
-	if (obj->meta == NULL)
-		return false;
-	src = simp_getheapdata(obj->meta);
+	if (simp_isfalse(simp_getvectormemb(ctx, CONTEXT_SOURCES)))
+		return true;
+	sources = getsources(ctx);
+	if (sources == NULL || sources->nsources == sources->maxsources)
+		if (!newsources(ctx, &sources))
+			return false;
+	src = &sources->sources[sources->nsources++];
 	src->filename = filename;
 	src->lineno = lineno;
 	src->column = column;
+	obj->meta = (uintptr_t)src | simp_gettype(*obj);
 	return true;
 }
 
@@ -744,9 +1513,7 @@ simp_getsource(Simp obj, const char **filename, SimpSiz *lineno, SimpSiz *column
 {
 	struct Source *src;
 
-	if (obj.meta == NULL)
-		return false;
-	if ((src = simp_getheapdata(obj.meta)) == NULL)
+	if (simp_isbuiltin(obj) || (src = (struct Source *)METAOF(obj)) == NULL)
 		return false;
 	if (filename != NULL)
 		*filename = src->filename;
@@ -758,7 +1525,10 @@ simp_getsource(Simp obj, const char **filename, SimpSiz *lineno, SimpSiz *column
 }
 
 Heap *
-simp_getsourcep(Simp obj)
+simp_getgcmeta(Simp obj)
 {
-	return obj.meta;
+	/* the bound arguments, or the table of the source location */
+	if (simp_isbuiltin(obj) || METAOF(obj) == NULL)
+		return METAOF(obj);
+	return simp_getheapof(METAOF(obj));
 }
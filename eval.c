@@ -1,6 +1,7 @@
 #include <limits.h>
 #include <setjmp.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -31,6 +32,38 @@
 #define ERROR_VARMACRO    "macro used as variable: "
 #define ERROR_VOID        "expression evaluated to nothing; expected value"
 
+/* number of variable references whose lexical address is cached */
+#define SITES_BITS        10
+#define SITES_SIZE        (1 << SITES_BITS)
+
+/* initial number of values in the stack, and of words of compiled code */
+#define STACK_SIZE        1024
+#define WORDS_SIZE        256
+
+/* end of a chain of jumps to be patched */
+#define NOLABEL           ((Word)-1)
+
+/*
+ * Compiled code is run by a switch on its opcodes.  If SIMP_THREADED is
+ * defined, it is run instead by jumping from the handler of each
+ * instruction straight to the handler of the next one, whose address
+ * replaces its opcode the first time the code is run.  Labels as values
+ * are only available as a compiler extension to C99, and threading was
+ * not measured to be faster than the switch, so it is left as opt-in.
+ */
+#if defined(SIMP_THREADED) && defined(__GNUC__)
+#define THREADED          1
+#define LABEL(op)         (__extension__ &&L_##op)
+#define DISPATCH(word)    __extension__ ({ goto *(void *)(word); });
+#define HANDLER(op)       L_##op:
+#define NEXT              __extension__ ({ goto *(void *)*pc++; })
+#else
+#define THREADED          0
+#define DISPATCH(word)    for (;;) switch (word)
+#define HANDLER(op)       case op:
+#define NEXT              break
+#endif
+
 #define MACRO_SPECIALS                                              \
 	/* SYMBOL               ENUM            NARGS   VARIADIC */ \
 	X("defmacro",           BLTIN_DEFMACRO, 2,      true       )\
@@ -56,78 +89,79 @@
 	X("redefine",           f_redefine,     2,      false      )\
 	X("true",               f_true,         0,      false      )
 
-#define PROCEDURE_ROUTINES                                          \
-	/* SYMBOL               FUNCTION        NARGS   VARIADIC */ \
-	X("*",                  f_multiply,     0,      true       )\
-	X("+",                  f_add,          0,      true       )\
-	X("-",                  f_subtract,     1,      true       )\
-	X("/",                  f_divide,       1,      true       )\
-	X("<",                  f_lt,           0,      true       )\
-	X("<=",                 f_le,           0,      true       )\
-	X("=",                  f_equal,        1,      true       )\
-	X(">",                  f_gt,           0,      true       )\
-	X(">=",                 f_ge,           0,      true       )\
-	X("abs",                f_abs,          1,      false      )\
-	X("alloc",              f_makevector,   1,      false      )\
-	X("boolean?",           f_booleanp,     1,      false      )\
-	X("byte?",              f_bytep,        1,      false      )\
-	X("car",                f_car,          1,      false      )\
-	X("cdr",                f_cdr,          1,      false      )\
-	X("clone",              f_vectordup,    0,      true       )\
-	X("concat",             f_vectorcat,    0,      true       )\
-	X("copy!",              f_vectorcpy,    2,      false      )\
-	X("display",            f_display,      1,      true       )\
-	X("empty?",             f_emptyp,       1,      false      )\
-	X("environment",        f_envnew,       1,      false      )\
-	X("environment-current",f_envcur,       0,      false      )\
-	X("environment-empty",  f_envnul,       0,      false      )\
-	X("environment?",       f_envp,         1,      false      )\
-	X("eof?",               f_eofp,         1,      false      )\
-	X("equiv?",             f_vectoreqv,    0,      true       )\
-	X("false?",             f_falsep,       1,      false      )\
-	X("for-each",           f_foreach,      1,      true       )\
-	X("get",                f_vectorref,    2,      false      )\
-	X("length",             f_vectorlen,    1,      false      )\
-	X("map",                f_map,          1,      true       )\
-	X("member",             f_member,       3,      false      )\
-	X("newline",            f_newline,      0,      true       )\
-	X("not",                f_not,          1,      false      )\
-	X("null?",              f_nullp,        1,      false      )\
-	X("number?",            f_numberp,      1,      false      )\
-	X("port?",              f_portp,        1,      false      )\
-	X("procedure?",         f_procedurep,   1,      false      )\
-	X("read",               f_read,         0,      true       )\
-	X("remainder",          f_remainder,    2,      false      )\
-	X("reverse",            f_vectorrevnew, 1,      false      )\
-	X("reverse!",           f_vectorrev,    1,      false      )\
-	X("same?",              f_samep,        1,      true       )\
-	X("set!",               f_vectorset,    3,      false      )\
-	X("slice",              f_slicevector,  1,      true       )\
-	X("stderr",             f_stderr,       0,      false      )\
-	X("stdin",              f_stdin,        0,      false      )\
-	X("stdout",             f_stdout,       0,      false      )\
-	X("string",             f_string,       0,      true       )\
-	X("string-<=?",         f_stringle,     0,      true       )\
-	X("string-<?",          f_stringlt,     0,      true       )\
-	X("string->=?",         f_stringge,     0,      true       )\
-	X("string->?",          f_stringgt,     0,      true       )\
-	X("string->vector",     f_stringvector, 1,      false      )\
-	X("string-alloc",       f_makestring,   1,      false      )\
-	X("string-clone",       f_stringdup,    1,      false      )\
-	X("string-concat",      f_stringcat,    0,      true       )\
-	X("string-copy!",       f_stringcpy,    2,      false      )\
-	X("string-get",         f_stringref,    2,      false      )\
-	X("string-length",      f_stringlen,    1,      false      )\
-	X("string-for-each",    f_foreachstring,1,      true       )\
-	X("string-map",         f_mapstring,    1,      true       )\
-	X("string-set!",        f_stringset,    3,      false      )\
-	X("string?",            f_stringp,      1,      false      )\
-	X("string-slice",       f_slicestring,  1,      true       )\
-	X("symbol?",            f_symbolp,      1,      false      )\
-	X("true?",              f_truep,        1,      false      )\
-	X("vector",             f_vector,       0,      true       )\
-	X("vector?",            f_vectorp,      1,      false      )\
-	X("write",              f_write,        1,      true       )
+#define PROCEDURE_ROUTINES                                                     \
+	/* SYMBOL               FUNCTION        NARGS   VARIADIC FIXNUM     */ \
+	X("*",                  f_multiply,     0,      true,    fix_multiply )\
+	X("+",                  f_add,          0,      true,    fix_add      )\
+	X("-",                  f_subtract,     1,      true,    fix_subtract )\
+	X("/",                  f_divide,       1,      true,    NULL         )\
+	X("<",                  f_lt,           0,      true,    fix_lt       )\
+	X("<=",                 f_le,           0,      true,    NULL         )\
+	X("=",                  f_equal,        1,      true,    fix_equal    )\
+	X(">",                  f_gt,           0,      true,    NULL         )\
+	X(">=",                 f_ge,           0,      true,    NULL         )\
+	X("abs",                f_abs,          1,      false,   NULL         )\
+	X("alloc",              f_makevector,   1,      false,   NULL         )\
+	X("boolean?",           f_booleanp,     1,      false,   NULL         )\
+	X("byte?",              f_bytep,        1,      false,   NULL         )\
+	X("car",                f_car,          1,      false,   NULL         )\
+	X("cdr",                f_cdr,          1,      false,   NULL         )\
+	X("clone",              f_vectordup,    0,      true,    NULL         )\
+	X("concat",             f_vectorcat,    0,      true,    NULL         )\
+	X("copy!",              f_vectorcpy,    2,      false,   NULL         )\
+	X("display",            f_display,      1,      true,    NULL         )\
+	X("empty?",             f_emptyp,       1,      false,   NULL         )\
+	X("environment",        f_envnew,       1,      false,   NULL         )\
+	X("environment-current",f_envcur,       0,      false,   NULL         )\
+	X("environment-empty",  f_envnul,       0,      false,   NULL         )\
+	X("environment?",       f_envp,         1,      false,   NULL         )\
+	X("eof?",               f_eofp,         1,      false,   NULL         )\
+	X("equiv?",             f_vectoreqv,    0,      true,    NULL         )\
+	X("false?",             f_falsep,       1,      false,   NULL         )\
+	X("for-each",           f_foreach,      1,      true,    NULL         )\
+	X("get",                f_vectorref,    2,      false,   NULL         )\
+	X("length",             f_vectorlen,    1,      false,   NULL         )\
+	X("map",                f_map,          1,      true,    NULL         )\
+	X("member",             f_member,       3,      false,   NULL         )\
+	X("newline",            f_newline,      0,      true,    NULL         )\
+	X("not",                f_not,          1,      false,   NULL         )\
+	X("null?",              f_nullp,        1,      false,   NULL         )\
+	X("number?",            f_numberp,      1,      false,   NULL         )\
+	X("port?",              f_portp,        1,      false,   NULL         )\
+	X("procedure?",         f_procedurep,   1,      false,   NULL         )\
+	X("read",               f_read,         0,      true,    NULL         )\
+	X("remainder",          f_remainder,    2,      false,   fix_remainder)\
+	X("reverse",            f_vectorrevnew, 1,      false,   NULL         )\
+	X("reverse!",           f_vectorrev,    1,      false,   NULL         )\
+	X("runtime-stats",      f_runtimestats, 0,      false,   NULL         )\
+	X("same?",              f_samep,        1,      true,    NULL         )\
+	X("set!",               f_vectorset,    3,      false,   NULL         )\
+	X("slice",              f_slicevector,  1,      true,    NULL         )\
+	X("stderr",             f_stderr,       0,      false,   NULL         )\
+	X("stdin",              f_stdin,        0,      false,   NULL         )\
+	X("stdout",             f_stdout,       0,      false,   NULL         )\
+	X("string",             f_string,       0,      true,    NULL         )\
+	X("string-<=?",         f_stringle,     0,      true,    NULL         )\
+	X("string-<?",          f_stringlt,     0,      true,    NULL         )\
+	X("string->=?",         f_stringge,     0,      true,    NULL         )\
+	X("string->?",          f_stringgt,     0,      true,    NULL         )\
+	X("string->vector",     f_stringvector, 1,      false,   NULL         )\
+	X("string-alloc",       f_makestring,   1,      false,   NULL         )\
+	X("string-clone",       f_stringdup,    1,      false,   NULL         )\
+	X("string-concat",      f_stringcat,    0,      true,    NULL         )\
+	X("string-copy!",       f_stringcpy,    2,      false,   NULL         )\
+	X("string-get",         f_stringref,    2,      false,   NULL         )\
+	X("string-length",      f_stringlen,    1,      false,   NULL         )\
+	X("string-for-each",    f_foreachstring,1,      true,    NULL         )\
+	X("string-map",         f_mapstring,    1,      true,    NULL         )\
+	X("string-set!",        f_stringset,    3,      false,   NULL         )\
+	X("string?",            f_stringp,      1,      false,   NULL         )\
+	X("string-slice",       f_slicestring,  1,      true,    NULL         )\
+	X("symbol?",            f_symbolp,      1,      false,   NULL         )\
+	X("true?",              f_truep,        1,      false,   NULL         )\
+	X("vector",             f_vector,       0,      true,    NULL         )\
+	X("vector?",            f_vectorp,      1,      false,   NULL         )\
+	X("write",              f_write,        1,      true,    NULL         )
 
 #define AUXILIARY_SYNTAX                                            \
 	/* SYMBOL               ENUM                             */ \
@@ -142,14 +176,175 @@ enum {
 	NAUXILIARIES
 };
 
+enum {
+	/* compiled code is its string of words and its constants */
+	CODE_WORDS,
+	CODE_CONSTANTS,
+	CODE_SIZE,
+};
+
+enum {
+	/* slots of the stack below the values pushed by running code */
+	FRAME_CODE,
+	FRAME_ENVIRONMENT,
+	FRAME_SIZE,
+};
+
+/*
+ * Opcodes of compiled code, and their number of operands.  K is the
+ * index of a constant, S is the index of a site, E is the index of the
+ * expression an instruction was compiled from (for the errors it may
+ * raise), and A is the index of a word to jump to.  Each expression
+ * pushes its value on the stack.
+ *
+ * CONST K              push K
+ * VAR K S              push the value of variable K
+ * FUNC K S E A         push the value of operator K; or, if it is now
+ *                      a macro, push the value of E and jump to A
+ * CALL N E             apply the value under the N top ones to them
+ * TAIL N E             apply it in place of the running code
+ * MACRO E S K          push the value of macro call E, whose code
+ *                      (if any) is cached in K
+ * TAILMACRO E S K      evaluate it in place of the running code
+ * SYNTAX A             jump to A if a macro has been defined since
+ *                      the code was compiled
+ * JUMP A               jump to A
+ * JUMPF E A            pop; jump to A if it is false
+ * AND E A              jump to A if the top is false; pop otherwise
+ * OR E A               jump to A if the top is true; pop otherwise
+ * VALUE E              fail if the top is void
+ * POP                  pop
+ * RETURN               pop; return it
+ * LAMBDA K             push a closure of lambda expression K, over
+ *                      the arguments K+1, and with the code K+2
+ * DEFINE K E           bind variable K to the top; make it void
+ * DEFSYNTAX K E        bind macro K to the top; make it void
+ * REDEFINE K E         rebind variable K to the top; make it void
+ * ENTER                push the environment; extend it
+ * BIND K E             pop; bind variable K to it
+ * LEAVE                pop; pop the environment back; push
+ * ERROR E K K M        fail with message M
+ */
+#define OPCODES                                                     \
+	/* OPCODE               OPERANDS */                         \
+	X(OP_CONST,             1       )                           \
+	X(OP_VAR,               2       )                           \
+	X(OP_FUNC,              4       )                           \
+	X(OP_CALL,              2       )                           \
+	X(OP_TAIL,              2       )                           \
+	X(OP_MACRO,             3       )                           \
+	X(OP_TAILMACRO,         3       )                           \
+	X(OP_SYNTAX,            1       )                           \
+	X(OP_JUMP,              1       )                           \
+	X(OP_JUMPF,             2       )                           \
+	X(OP_AND,               2       )                           \
+	X(OP_OR,                2       )                           \
+	X(OP_VALUE,             1       )                           \
+	X(OP_POP,               0       )                           \
+	X(OP_RETURN,            0       )                           \
+	X(OP_LAMBDA,            1       )                           \
+	X(OP_DEFINE,            2       )                           \
+	X(OP_DEFSYNTAX,         2       )                           \
+	X(OP_REDEFINE,          2       )                           \
+	X(OP_ENTER,             0       )                           \
+	X(OP_BIND,              2       )                           \
+	X(OP_LEAVE,             0       )                           \
+	X(OP_ERROR,             4       )
+
+enum {
+#define X(op, n) op,
+	OPCODES
+#undef  X
+	NOPCODES
+};
+
+enum {
+	/* messages of the errors found at compilation */
+	MESSAGE_EMPTY,
+	MESSAGE_ILLMACRO,
+	MESSAGE_NARGS,
+	MESSAGE_NOTSYM,
+};
+
+static const char *const messages[] = {
+	[MESSAGE_EMPTY]         = ERROR_EMPTY,
+	[MESSAGE_ILLMACRO]      = ERROR_ILLMACRO,
+	[MESSAGE_NARGS]         = ERROR_NARGS,
+	[MESSAGE_NOTSYM]        = ERROR_NOTSYM,
+};
+
+/* a word of compiled code: an opcode (or its handler), or an operand */
+typedef uintptr_t Word;
+
+typedef struct Site {
+	/* slot of an expression, and where its variable was found */
+	Simp *slot;
+	SimpSiz depth;
+	SimpSiz index;
+
+	/* cell of the global binding of the variable, if cached */
+	Simp *cell;
+	Heap *sym;
+	SimpInt version;
+
+	/* cell of the global syntax binding of the operator, if cached */
+	Simp *syncell;
+	Heap *synsym;
+	SimpInt synversion;
+} Site;
+
+typedef struct Code {
+	/*
+	 * Compiled code is a string beginning with this header, followed
+	 * by the sites of the variables and operators it refers to, and
+	 * then by its words: each instruction is an opcode followed by
+	 * its operands.
+	 */
+	SimpInt version;        /* syntax version it was compiled for */
+	Builtin *form;          /* builtin macro it was compiled from */
+	SimpSiz maxstack;       /* number of values it pushes at most */
+	SimpSiz ndefines;       /* number of variables it defines at most */
+	SimpSiz nsites;
+	SimpSiz nwords;
+	bool threaded;          /* whether its opcodes are handlers */
+} Code;
+
 typedef struct Eval {
 	Simp ctx;
 	Simp env;
 	Simp aux[NAUXILIARIES];
 	Simp iport, oport, eport;
+	SimpStats *stats;
+	Site sites[SITES_SIZE];
+
+	/* stack of values of the running code */
+	Simp *stack;
+	SimpSiz sp, maxstack;
+
+	/* number of times the current environment was made a value */
+	SimpSiz ncaptures;
+
+	/* words and constants of the code being compiled */
+	Word *words;
+	SimpSiz nwords, maxwords;
+	Simp *consts;
+	SimpSiz nconsts, maxconsts;
+
 	jmp_buf jmp;
 } Eval;
 
+typedef struct Compiler {
+	Eval *eval;
+	SimpSiz words;          /* first word of the code in eval->words */
+	SimpSiz consts;         /* first constant of the code in eval->consts */
+	SimpSiz nsites;
+	SimpSiz depth;
+	SimpSiz maxdepth;
+	SimpSiz ndefines;
+	bool nomacros;          /* compiled for the empty environment */
+	bool inlining;          /* compiling the body of a macro inline */
+} Compiler;
+
 struct Builtin {
 	/* data for builtin procedure or builtin macro */
 	unsigned char *name;
@@ -165,13 +360,36 @@ struct Builtin {
 	SimpSiz namelen;
 
 	/*
-	 * The .fun member is only used when .type is BLTIN_ROUTINE.
-	 * It is ignored otherwise.
+	 * The name interned (and pinned) by simp_environmentnew(),
+	 * passed as self to the routine.
+	 */
+	Simp self;
+
+	/*
+	 * The .fun member (for procedures) or the .macro member (for
+	 * macros) is only used when .type is BLTIN_ROUTINE.  It is
+	 * ignored otherwise.
+	 *
+	 * A procedure receives its arguments as a view into the value
+	 * stack, which is only valid until the evaluator is entered
+	 * again (the stack may be reallocated then), and must be copied
+	 * into a vector if retained.  A macro receives its operands as
+	 * a slice of the form being expanded.
+	 */
+	void (*fun)(Eval *, Simp *, Simp, Simp, Simp, Simp *, SimpSiz);
+	void (*macro)(Eval *, Simp *, Simp, Simp, Simp, Simp);
+
+	/*
+	 * The .fix member, if not NULL, is tried before .fun.  It
+	 * computes the value of a procedure applied to one or two
+	 * signums without allocating, and returns false to leave the
+	 * call (with other arguments or an error) to .fun.
 	 */
-	void (*fun)(Eval *, Simp *, Simp, Simp, Simp, Simp);
+	bool (*fix)(Eval *, Simp *, Simp *, SimpSiz);
 };
 
 static Simp simp_eval(Eval *eval, Simp expr, Simp env);
+static Simp apply(Eval *eval, Simp expr, Simp env, SimpSiz n);
 
 static void
 error(Eval *eval, Simp expr, Simp sym, Simp obj, const char *errmsg)
@@ -208,66 +426,184 @@ memerror(Eval *eval)
 	error(eval, simp_nil(), simp_void(), simp_void(), ERROR_MEMORY);
 }
 
+static void
+gcprotect(Eval *eval, Simp *obj)
+{
+	/*
+	 * The collector may run whenever code is run or a procedure is
+	 * applied, so any local variable holding an object that is used
+	 * after a call to simp_eval or apply must be protected (or be
+	 * pushed on the stack).
+	 */
+	if (!simp_gcprotect(eval->ctx, obj))
+		memerror(eval);
+}
+
+static void
+reserve(Eval *eval, SimpSiz n)
+{
+	Simp *stack;
+	SimpSiz size;
+
+	/* make room for n more values on the stack */
+	if (eval->sp + n <= eval->maxstack)
+		return;
+	size = eval->maxstack > 0 ? eval->maxstack : STACK_SIZE;
+	while (size < eval->sp + n)
+		size *= 2;
+	if ((stack = realloc(eval->stack, size * sizeof(*stack))) == NULL)
+		memerror(eval);
+	eval->stack = stack;
+	eval->maxstack = size;
+}
+
+static void
+gcpoint(Eval *eval)
+{
+	/* the values on the stack are the roots of the running code */
+	if (simp_gcneeded(eval->ctx))
+		simp_gc(eval->ctx, eval->stack, eval->sp);
+}
+
 static bool
-syntaxget(Simp *macro, Simp env, Simp sym)
+framefind(Simp frame, Simp sym, SimpSiz *pos)
 {
-	Simp bind, var;
+	SimpSiz i, n;
 
-	for (; !simp_isnulenv(env); env = simp_getenvparent(env)) {
-		for (bind = simp_getenvsynframe(env);
-		     !simp_isnil(bind);
-		     bind = simp_getnextbind(bind)) {
-			var = simp_getbindvariable(bind);
-			if (!simp_issame(var, sym))
-				continue;
+	n = simp_getframesize(frame);
+	for (i = 0; i < n; i++) {
+		if (simp_issame(simp_getframevariable(frame, i), sym)) {
+			*pos = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static Site *
+getsite(Eval *eval, Simp *slot)
+{
+	Site *site;
+	uintptr_t h;
+
+	h = (uintptr_t)slot / sizeof(*slot);
+	h *= (uintptr_t)0x9E3779B97F4A7C15;
+	site = &eval->sites[h >> (sizeof(h) * CHAR_BIT - SITES_BITS)];
+	if (site->slot != slot) {
+		site->slot = slot;
+		site->depth = site->index = 0;
+		site->cell = site->syncell = NULL;
+	}
+	return site;
+}
+
+static bool
+syntaxget(Eval *eval, Simp *macro, Simp env, Simp sym, Site *site)
+{
+	Simp frame;
+	SimpSiz i;
+	SimpInt version;
+
+	/*
+	 * A symbol which has never been bound in a syntax frame is not
+	 * looked up at all.  The cell of a global syntax binding is
+	 * cached for the site of the operator it was looked up from, as
+	 * for variables; the version of the context changes whenever a
+	 * syntax binding is made out of the global frame.
+	 */
+	if (!simp_issymbol(sym) || !simp_issyntax(sym) || simp_isnulenv(env))
+		return false;
+	version = simp_contextversion(eval->ctx);
+	if (site != NULL) {
+		if (site->syncell != NULL &&
+		    site->synversion == version &&
+		    site->synsym == simp_getgcmemory(sym)) {
 			if (macro != NULL)
-				*macro = simp_getbindvalue(bind);
+				*macro = *site->syncell;
 			return true;
 		}
+		site->syncell = NULL;
+	}
+	for (; !simp_isnulenv(env); env = simp_getenvparent(env)) {
+		frame = simp_getenvsynframe(env);
+		if (!framefind(frame, sym, &i))
+			continue;
+		if (site != NULL && version >= 0 &&
+		    simp_isnulenv(simp_getenvparent(env))) {
+			site->syncell = simp_getframecell(frame, i);
+			site->synsym = simp_getgcmemory(sym);
+			site->synversion = version;
+		}
+		if (macro != NULL)
+			*macro = simp_getframevalue(frame, i);
+		return true;
 	}
 	return false;
 }
 
 static Simp
-envget(Eval *eval, Simp expr, Simp mainenv, Simp sym)
-{
-	enum { SYNTAX_ENV, NORMAL_ENV, LAST_ENV } i;
-	Simp bind, var, env;
-	const char *errstr = ERROR_VARMACRO;
-
-	for (i = 0; i < LAST_ENV; i++) {
-		for (env = mainenv;
-		     !simp_isnulenv(env);
-		     env = simp_getenvparent(env)) {
-			if (i == SYNTAX_ENV)
-				bind = simp_getenvsynframe(env);
-			else
-				bind = simp_getenvframe(env);
-			for (;
-			     !simp_isnil(bind);
-			     bind = simp_getnextbind(bind)) {
-				var = simp_getbindvariable(bind);
-				if (!simp_issame(var, sym))
-					continue;
-				if (i == SYNTAX_ENV)
-					goto syntax_error;
-				return simp_getbindvalue(bind);
-			}
+envget(Eval *eval, Simp expr, Simp env, Simp sym, Site *site)
+{
+	Simp frame;
+	SimpSiz depth, i;
+	SimpInt version;
+
+	/*
+	 * The lexical address of the binding a variable was read from is
+	 * cached for the site of the expression the variable was read
+	 * from.  The frames nearer than the cached depth are still looked
+	 * up (a binding may have been defined there since, or the same
+	 * expression may be evaluated in another environment), but the
+	 * frame at the cached depth is accessed by index rather than
+	 * scanned.  In a procedure, its parameters are in the nearest
+	 * frame, so they are accessed without any scan.
+	 *
+	 * A variable which has only ever been bound in the global frame
+	 * cannot be shadowed by a nearer frame; the cell of its global
+	 * binding is cached instead, and read with no lookup at all
+	 * while the version of the context is the same.
+	 */
+	version = simp_contextversion(eval->ctx);
+	if (site != NULL && !simp_isnulenv(env)) {
+		if (site->cell != NULL &&
+		    site->version == version &&
+		    site->sym == simp_getgcmemory(sym))
+			return *site->cell;
+		site->cell = NULL;
+	}
+	if (syntaxget(eval, NULL, env, sym, NULL))
+		error(eval, expr, simp_void(), sym, ERROR_VARMACRO);
+	for (depth = 0; !simp_isnulenv(env); depth++, env = simp_getenvparent(env)) {
+		frame = simp_getenvframe(env);
+		if (site != NULL && site->depth == depth &&
+		    site->index < simp_getframesize(frame) &&
+		    simp_issame(simp_getframevariable(frame, site->index), sym))
+			i = site->index;
+		else if (!simp_envfind(env, sym, &i))
+			continue;
+		if (site == NULL)
+			return simp_getframevalue(frame, i);
+		site->depth = depth;
+		site->index = i;
+		if (version >= 0 && simp_isnulenv(simp_getenvparent(env)) &&
+		    !simp_issyntax(sym) && !simp_islocal(sym)) {
+			site->cell = simp_getframecell(frame, i);
+			site->sym = simp_getgcmemory(sym);
+			site->version = version;
 		}
+		return simp_getframevalue(frame, i);
 	}
-	errstr = ERROR_UNBOUND;
-syntax_error:
-	error(eval, expr, simp_void(), sym, errstr);
+	error(eval, expr, simp_void(), sym, ERROR_UNBOUND);
 	abort();
 }
 
 static void
 envset(Eval *eval, Simp expr, Simp env, Simp var, Simp val, bool syntax)
 {
-	if (!syntax && syntaxget(NULL, env, var))
+	if (!syntax && syntaxget(eval, NULL, env, var, NULL))
 		error(eval, expr, simp_void(), var, ERROR_VARMACRO);
 	for (; !simp_isnulenv(env); env = simp_getenvparent(env))
-		if (simp_envredefine(env, var, val, syntax))
+		if (simp_envredefine(eval->ctx, env, var, val, syntax))
 			return;
 	error(eval, expr, simp_void(), var, ERROR_UNBOUND);
 }
@@ -275,23 +611,66 @@ envset(Eval *eval, Simp expr, Simp env, Simp var, Simp val, bool syntax)
 static void
 envdef(Eval *eval, Simp expr, Simp env, Simp var, Simp val, bool syntax)
 {
-	if (!syntax && syntaxget(NULL, env, var))
+	if (!syntax && syntaxget(eval, NULL, env, var, NULL))
 		error(eval, expr, simp_void(), var, ERROR_VARMACRO);
-	if (simp_envredefine(env, var, val, syntax))
+	if (simp_envredefine(eval->ctx, env, var, val, syntax))
 		return;
 	if (!simp_envdefine(eval->ctx, env, var, val, syntax))
 		memerror(eval);
 }
 
+static Simp
+evalmemb(Eval *eval, Simp vector, SimpSiz pos, Simp env)
+{
+	Simp *slot;
+
+	/* a variable is looked up here, where its slot is known */
+	slot = &simp_getvector(vector)[pos];
+	if (!simp_issymbol(*slot))
+		return simp_eval(eval, *slot, env);
+	eval->stats->nevals++;
+	return envget(eval, *slot, env, *slot, getsite(eval, slot));
+}
+
 static void
-typepred(Simp args, Simp *ret, bool (*pred)(Simp))
+typepred(Simp *args, Simp *ret, bool (*pred)(Simp))
 {
 	Simp obj;
 
-	obj = simp_getvectormemb(args, 0);
+	obj = args[0];
 	*ret = (*pred)(obj) ? simp_true() : simp_false();
 }
 
+static Simp
+statpair(Eval *eval, const char *name, Simp val)
+{
+	Simp pair, sym;
+
+	if (!simp_makesymbol(eval->ctx, &sym, (unsigned char *)name, strlen(name)))
+		memerror(eval);
+	if (!simp_makevector(eval->ctx, &pair, 2))
+		memerror(eval);
+	simp_setvector(eval->ctx, pair, 0, sym);
+	simp_setvector(eval->ctx, pair, 1, val);
+	return pair;
+}
+
+static Simp
+statcounts(Eval *eval, SimpSiz *counts, SimpSiz ncounts)
+{
+	Simp vector, num;
+	SimpSiz i;
+
+	if (!simp_makevector(eval->ctx, &vector, ncounts))
+		memerror(eval);
+	for (i = 0; i < ncounts; i++) {
+		if (!simp_makesignum(eval->ctx, &num, counts[i]))
+			memerror(eval);
+		simp_setvector(eval->ctx, vector, i, num);
+	}
+	return vector;
+}
+
 static int
 stringcmp(Simp a, Simp b)
 {
@@ -310,13 +689,127 @@ stringcmp(Simp a, Simp b)
 	return cmp;
 }
 
+static int
+fixnums(Simp *args, SimpSiz nargs, SimpInt *a, SimpInt *b)
+{
+	/* return how many signums there are in one or two arguments */
+	if (nargs < 1 || nargs > 2 || !simp_issignum(args[0]))
+		return 0;
+	*a = simp_getsignum(args[0]);
+	if (nargs == 1)
+		return 1;
+	if (!simp_issignum(args[1]))
+		return 0;
+	*b = simp_getsignum(args[1]);
+	return 2;
+}
+
+static bool
+fix_add(Eval *eval, Simp *sum, Simp *args, SimpSiz nargs)
+{
+	SimpInt a, b;
+
+	switch (fixnums(args, nargs, &a, &b)) {
+	case 1:
+		return simp_makesignum(eval->ctx, sum, a);
+	case 2:
+		if (b > 0 ? a > LLONG_MAX - b : a < LLONG_MIN - b)
+			return false;
+		return simp_makesignum(eval->ctx, sum, a + b);
+	}
+	return false;
+}
+
+static bool
+fix_equal(Eval *eval, Simp *ret, Simp *args, SimpSiz nargs)
+{
+	SimpInt a, b;
+
+	(void)eval;
+	switch (fixnums(args, nargs, &a, &b)) {
+	case 1:
+		*ret = simp_true();
+		return true;
+	case 2:
+		*ret = (a == b) ? simp_true() : simp_false();
+		return true;
+	}
+	return false;
+}
+
+static bool
+fix_lt(Eval *eval, Simp *ret, Simp *args, SimpSiz nargs)
+{
+	SimpInt a, b;
+
+	(void)eval;
+	switch (fixnums(args, nargs, &a, &b)) {
+	case 1:
+		*ret = simp_true();
+		return true;
+	case 2:
+		*ret = (a < b) ? simp_true() : simp_false();
+		return true;
+	}
+	return false;
+}
+
+static bool
+fix_multiply(Eval *eval, Simp *prod, Simp *args, SimpSiz nargs)
+{
+	SimpInt a, b;
+
+	switch (fixnums(args, nargs, &a, &b)) {
+	case 1:
+		return simp_makesignum(eval->ctx, prod, a);
+	case 2:
+		if (a == 0 || b == 0)
+			return simp_makesignum(eval->ctx, prod, 0);
+		if (a > 0 ? (b > 0 ? a > LLONG_MAX / b : b < LLONG_MIN / a)
+		          : (b > 0 ? a < LLONG_MIN / b : a < LLONG_MAX / b))
+			return false;
+		return simp_makesignum(eval->ctx, prod, a * b);
+	}
+	return false;
+}
+
+static bool
+fix_remainder(Eval *eval, Simp *ret, Simp *args, SimpSiz nargs)
+{
+	SimpInt a, b;
+
+	/* a zero divisor is reported by f_remainder */
+	if (fixnums(args, nargs, &a, &b) != 2 || b == 0 || b == -1)
+		return false;
+	return simp_makesignum(eval->ctx, ret, a % b);
+}
+
+static bool
+fix_subtract(Eval *eval, Simp *diff, Simp *args, SimpSiz nargs)
+{
+	SimpInt a, b;
+
+	switch (fixnums(args, nargs, &a, &b)) {
+	case 1:
+		if (a == LLONG_MIN)
+			return false;
+		return simp_makesignum(eval->ctx, diff, -a);
+	case 2:
+		if (b < 0 ? a > LLONG_MAX + b : a < LLONG_MIN + b)
+			return false;
+		return simp_makesignum(eval->ctx, diff, a - b);
+	}
+	return false;
+}
+
 static void
-f_abs(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_abs(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp obj;
 
 	(void)env;
-	obj = simp_getvectormemb(args, 0);
+	(void)nargs;
+	obj = args[0];
 	if (!simp_isnum(obj))
 		error(eval, expr, self, obj, ERROR_NOTNUM);
 	if (!simp_arithabs(eval->ctx, ret, obj))
@@ -324,17 +817,16 @@ f_abs(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_add(Eval *eval, Simp *sum, Simp self, Simp expr, Simp env, Simp args)
+f_add(Eval *eval, Simp *sum, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	SimpSiz nargs, i;
+	SimpSiz i;
 	Simp obj;
 
 	(void)env;
-	nargs = simp_getsize(args);
 	if (!simp_makesignum(eval->ctx, sum, 0))
 		memerror(eval);
 	for (i = 0; i < nargs; i++) {
-		obj = simp_getvectormemb(args, i);
+		obj = args[i];
 		if (!simp_isnum(obj))
 			error(eval, expr, self, obj, ERROR_NOTNUM);
 		if (!simp_arithadd(eval->ctx, sum, *sum, obj))
@@ -350,8 +842,7 @@ f_and(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 	nargs = simp_getsize(args);
 	*ret = simp_true();
 	for (i = 0; i < nargs; i++) {
-		*ret = simp_getvectormemb(args, i);
-		*ret = simp_eval(eval, *ret, env);
+		*ret = evalmemb(eval, args, i, env);
 		if (simp_isvoid(*ret))
 			error(eval, expr, self, simp_void(), ERROR_VOID);
 		if (simp_isfalse(*ret)) {
@@ -370,34 +861,37 @@ f_auxiliary(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_bytep(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_bytep(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)expr;
 	(void)self;
 	(void)env;
+	(void)nargs;
 	typepred(args, ret, simp_isbyte);
 }
 
 static void
-f_booleanp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_booleanp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)expr;
 	(void)self;
 	(void)env;
+	(void)nargs;
 	typepred(args, ret, simp_isbool);
 }
 
 static void
-f_car(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_car(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	SimpSiz size;
 	Simp obj;
 
 	(void)eval;
 	(void)env;
-	obj = simp_getvectormemb(args, 0);
+	(void)nargs;
+	obj = args[0];
 	if (!simp_isvector(obj))
 		error(eval, expr, self, obj, ERROR_NOTINT);
 	size = simp_getsize(obj);
@@ -407,14 +901,15 @@ f_car(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_cdr(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_cdr(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	SimpSiz size;
 	Simp obj;
 
 	(void)eval;
 	(void)env;
-	obj = simp_getvectormemb(args, 0);
+	(void)nargs;
+	obj = args[0];
 	if (!simp_isvector(obj))
 		error(eval, expr, self, obj, ERROR_NOTVECTOR);
 	size = simp_getsize(obj);
@@ -424,35 +919,38 @@ f_cdr(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_stdin(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_stdin(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)ret;
 	(void)self;
 	(void)expr;
 	(void)args;
 	(void)env;
+	(void)nargs;
 	*ret = eval->iport;
 }
 
 static void
-f_stdout(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_stdout(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)ret;
 	(void)self;
 	(void)expr;
 	(void)args;
 	(void)env;
+	(void)nargs;
 	*ret = eval->oport;
 }
 
 static void
-f_stderr(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_stderr(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)ret;
 	(void)self;
 	(void)expr;
 	(void)args;
 	(void)env;
+	(void)nargs;
 	*ret = eval->eport;
 }
 
@@ -463,26 +961,25 @@ f_define(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 
 	(void)ret;
 	var = simp_getvectormemb(args, 0);
-	val = simp_getvectormemb(args, 1);
 	if (!simp_issymbol(var))
 		error(eval, expr, self, var, ERROR_NOTSYM);
-	val = simp_eval(eval, val, env);
+	val = evalmemb(eval, args, 1, env);
 	envdef(eval, expr, env, var, val, false);
 }
 
 static void
-f_display(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_display(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp obj, port;
 
 	(void)env;
 	port = eval->oport;
-	switch (simp_getsize(args)) {
+	switch (nargs) {
 	case 2:
-		port = simp_getvectormemb(args, 1);
+		port = args[1];
 		/* FALLTHROUGH */
 	case 1:
-		obj = simp_getvectormemb(args, 0);
+		obj = args[0];
 		break;
 	default:
 		error(eval, expr, self, simp_void(), ERROR_NARGS);
@@ -495,17 +992,16 @@ f_display(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_divide(Eval *eval, Simp *ratio, Simp self, Simp expr, Simp env, Simp args)
+f_divide(Eval *eval, Simp *ratio, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	SimpSiz nargs, i;
+	SimpSiz i;
 	Simp obj;
 
 	(void)env;
-	nargs = simp_getsize(args);
 	if (!simp_makesignum(eval->ctx, ratio, 1))
 		memerror(eval);
 	for (i = 0; i < nargs; i++) {
-		obj = simp_getvectormemb(args, i);
+		obj = args[i];
 		if (!simp_isnum(obj))
 			error(eval, expr, self, obj, ERROR_NOTNUM);
 		if (nargs > 1 && i == 0) {
@@ -526,39 +1022,43 @@ f_divide(Eval *eval, Simp *ratio, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_emptyp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_emptyp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)expr;
 	(void)self;
 	(void)env;
+	(void)nargs;
 	typepred(args, ret, simp_isempty);
 }
 
 static void
-f_envcur(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_envcur(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	(void)eval;
 	(void)expr;
 	(void)self;
 	(void)args;
+	(void)nargs;
+	eval->ncaptures++;
 	*ret = env;
 }
 
 static void
-f_envp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_envp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)expr;
 	(void)self;
 	(void)env;
+	(void)nargs;
 	typepred(args, ret, simp_isenvironment);
 }
 
 static void
-f_envnew(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_envnew(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	env = simp_getvectormemb(args, 0);
+	(void)nargs;
+	env = args[0];
 	if (!simp_isenvironment(env))
 		error(eval, expr, self, env, ERROR_NOTENV);
 	if (!simp_makeenvironment(eval->ctx, ret, env))
@@ -566,38 +1066,39 @@ f_envnew(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_envnul(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_envnul(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)self;
 	(void)expr;
 	(void)env;
 	(void)args;
+	(void)nargs;
 	*ret = simp_nulenv();
 }
 
 static void
-f_eofp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_eofp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)self;
 	(void)expr;
 	(void)env;
+	(void)nargs;
 	typepred(args, ret, simp_iseof);
 }
 
 static void
-f_equal(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_equal(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	SimpSiz nargs, i;
+	SimpSiz i;
 	Simp next, prev;
 
 	(void)eval;
 	(void)env;
-	nargs = simp_getsize(args);
 	*ret = simp_true();
 	for (i = 0; i < nargs; i++, prev = next) {
-		next = simp_getvectormemb(args, i);
+		next = args[i];
 		if (!simp_isnum(next))
 			error(eval, expr, self, next, ERROR_NOTNUM);
 		if (i == 0)
@@ -621,32 +1122,31 @@ f_false(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_falsep(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_falsep(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)self;
 	(void)expr;
 	(void)env;
+	(void)nargs;
 	typepred(args, ret, simp_isfalse);
 }
 
 static void
-f_foreach(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_foreach(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp prod, obj;
-	SimpSiz i, j, n, size, nargs;
+	SimpSiz i, j, n, size, base;
 
-	(void)env;
 	*ret = simp_void();
-	nargs = simp_getsize(args);
 	if (nargs < 2)
 		error(eval, expr, self, simp_void(), ERROR_NARGS);
-	prod = simp_getvectormemb(args, 0);
+	prod = args[0];
 	if (!simp_isprocedure(prod))
 		error(eval, expr, self, prod, ERROR_NOTPROC);
 	size = 0;
 	for (i = 1; i < nargs; i++) {
-		obj = simp_getvectormemb(args, i);
+		obj = args[i];
 		if (!simp_isvector(obj))
 			error(eval, expr, self, obj, ERROR_NOTVECTOR);
 		n = simp_getsize(obj);
@@ -658,37 +1158,35 @@ f_foreach(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 			error(eval, expr, self, simp_void(), ERROR_MAP);
 		}
 	}
-	if (!simp_makevector(eval->ctx, &expr, nargs))
-		memerror(eval);
-	simp_setvector(expr, 0, prod);
+	/* the stack may move under apply(), so index the arguments */
+	base = args - eval->stack;
 	for (i = 0; i < size; i++) {
+		reserve(eval, nargs);
+		eval->stack[eval->sp++] = prod;
 		for (j = 1; j < nargs; j++) {
-			obj = simp_getvectormemb(args, j);
-			obj = simp_getvectormemb(obj, i);
-			simp_setvector(expr, j, obj);
+			obj = eval->stack[base + j];
+			eval->stack[eval->sp++] = simp_getvectormemb(obj, i);
 		}
-		(void)simp_eval(eval, expr, simp_nulenv());
+		(void)apply(eval, expr, env, nargs - 1);
 	}
 }
 
 static void
-f_foreachstring(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_foreachstring(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp prod, obj;
-	SimpSiz i, j, n, size, nargs;
+	SimpSiz i, j, n, size, base;
 	unsigned char byte;
 
-	(void)env;
 	*ret = simp_void();
-	nargs = simp_getsize(args);
 	if (nargs < 2)
 		error(eval, expr, self, simp_void(), ERROR_NARGS);
-	prod = simp_getvectormemb(args, 0);
+	prod = args[0];
 	if (!simp_isprocedure(prod))
 		error(eval, expr, self, prod, ERROR_NOTPROC);
 	size = 0;
 	for (i = 1; i < nargs; i++) {
-		obj = simp_getvectormemb(args, i);
+		obj = args[i];
 		if (!simp_isstring(obj))
 			error(eval, expr, self, obj, ERROR_NOTSTRING);
 		n = simp_getsize(obj);
@@ -700,33 +1198,33 @@ f_foreachstring(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args
 			error(eval, expr, self, simp_void(), ERROR_MAP);
 		}
 	}
-	if (!simp_makevector(eval->ctx, &expr, nargs))
-		memerror(eval);
-	simp_setvector(expr, 0, prod);
+	/* the stack may move under apply(), so index the arguments */
+	base = args - eval->stack;
 	for (i = 0; i < size; i++) {
+		reserve(eval, nargs);
+		eval->stack[eval->sp++] = prod;
 		for (j = 1; j < nargs; j++) {
-			obj = simp_getvectormemb(args, j);
+			obj = eval->stack[base + j];
 			byte = simp_getstringmemb(obj, i);
 			if (!simp_makebyte(eval->ctx, &obj, byte))
 				memerror(eval);
-			simp_setvector(expr, j, obj);
+			eval->stack[eval->sp++] = obj;
 		}
-		(void)simp_eval(eval, expr, simp_nulenv());
+		(void)apply(eval, expr, env, nargs - 1);
 	}
 }
 
 static void
-f_ge(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_ge(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	SimpSiz nargs, i;
+	SimpSiz i;
 	Simp next, prev;
 
 	(void)env;
 	(void)eval;
-	nargs = simp_getsize(args);
 	*ret = simp_true();
 	for (i = 0; i < nargs; i++, prev = next) {
-		next = simp_getvectormemb(args, i);
+		next = args[i];
 		if (!simp_isnum(next))
 			error(eval, expr, self, next, ERROR_NOTNUM);
 		if (i == 0)
@@ -739,17 +1237,16 @@ f_ge(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_gt(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_gt(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	SimpSiz nargs, i;
+	SimpSiz i;
 	Simp next, prev;
 
 	(void)env;
 	(void)eval;
 	*ret = simp_true();
-	nargs = simp_getsize(args);
 	for (i = 0; i < nargs; i++, prev = next) {
-		next = simp_getvectormemb(args, i);
+		next = args[i];
 		if (!simp_isnum(next))
 			error(eval, expr, self, next, ERROR_NOTNUM);
 		if (i == 0)
@@ -764,76 +1261,52 @@ f_gt(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 static void
 f_lambda(Eval *eval, Simp *body, Simp self, Simp expr, Simp env, Simp args)
 {
-	SimpSiz nargs;
-	Simp sym, lambda;
+	SimpSiz nargs, nparams, i;
+	Simp varargs, sym;
 
 	nargs = simp_getsize(args);
 	if (nargs == 0) {
 		if (!simp_makeclosure(
 			eval->ctx,
 			body, expr, env,
-			simp_false(), simp_false(),
+			simp_nil(), simp_false(),
 			simp_void()
 		)) memerror(eval);
 		return;
 	}
-	if (nargs == 1) {
-		if (!simp_makeclosure(
-			eval->ctx,
-			body, expr, env,
-			simp_false(), simp_false(),
-			simp_getvectormemb(args, 0)
-		)) memerror(eval);
-		return;
-	}
-	sym = simp_getvectormemb(args, 0);
-	if (!simp_issymbol(sym))
-		error(eval, expr, self, sym, ERROR_NOTSYM);
-	if (nargs == 3 && 
-	    simp_issame(simp_getvectormemb(args, 1), eval->aux[AUX_ELLIPSIS])) {
-		if (!simp_makeclosure(
-			eval->ctx,
-			body, expr, env,
-			sym, simp_true(),
-			simp_getvectormemb(args, 2)
-		)) memerror(eval);
-		return;
+	nparams = nargs - 1;
+	varargs = simp_false();
+	if (nargs >= 3 &&
+	    simp_issame(simp_getvectormemb(args, nargs - 2), eval->aux[AUX_ELLIPSIS])) {
+		nparams--;
+		varargs = simp_true();
 	}
-	if (nargs == 2) {
-		if (!simp_makeclosure(
-			eval->ctx,
-			body, expr, env,
-			sym, simp_false(),
-			simp_getvectormemb(args, 1)
-		)) memerror(eval);
-		return;
+	for (i = 0; i < nparams; i++) {
+		sym = simp_getvectormemb(args, i);
+		if (!simp_issymbol(sym))
+			error(eval, expr, self, sym, ERROR_NOTSYM);
+		if (syntaxget(eval, NULL, env, sym, NULL))
+			error(eval, expr, self, sym, ERROR_VARMACRO);
 	}
-	if (!simp_makevector(eval->ctx, body, nargs))
-		memerror(eval);
-	simp_cpyvector(*body, args);
-	if (!simp_makesymbol(eval->ctx, &lambda, (unsigned char *)"lambda", 6))
-		memerror(eval);
-	simp_setvector(*body, 0, lambda);
 	if (!simp_makeclosure(
 		eval->ctx,
 		body, expr, env,
-		sym, simp_false(),
-		*body
+		simp_slicevector(args, 0, nparams), varargs,
+		simp_getvectormemb(args, nargs - 1)
 	)) memerror(eval);
 }
 
 static void
-f_le(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_le(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	SimpSiz nargs, i;
+	SimpSiz i;
 	Simp next, prev;
 
 	(void)eval;
 	(void)env;
 	*ret = simp_true();
-	nargs = simp_getsize(args);
 	for (i = 0; i < nargs; i++, prev = next) {
-		next = simp_getvectormemb(args, i);
+		next = args[i];
 		if (!simp_isnum(next))
 			error(eval, expr, self, next, ERROR_NOTNUM);
 		if (i == 0)
@@ -846,17 +1319,16 @@ f_le(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_lt(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_lt(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	SimpSiz nargs, i;
+	SimpSiz i;
 	Simp next, prev;
 
 	(void)eval;
 	(void)env;
 	*ret = simp_true();
-	nargs = simp_getsize(args);
 	for (i = 0; i < nargs; i++, prev = next) {
-		next = simp_getvectormemb(args, i);
+		next = args[i];
 		if (!simp_isnum(next))
 			error(eval, expr, self, next, ERROR_NOTNUM);
 		if (i == 0)
@@ -869,13 +1341,14 @@ f_lt(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_makestring(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_makestring(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	SimpInt size;
 	Simp obj;
 
 	(void)env;
-	obj = simp_getvectormemb(args, 0);
+	(void)nargs;
+	obj = args[0];
 	if (!simp_issignum(obj))
 		error(eval, expr, self, obj, ERROR_NOTINT);
 	size = simp_getsignum(obj);
@@ -886,13 +1359,14 @@ f_makestring(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_makevector(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_makevector(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	SimpInt size;
 	Simp obj;
 
 	(void)env;
-	obj = simp_getvectormemb(args, 0);
+	(void)nargs;
+	obj = args[0];
 	if (!simp_issignum(obj))
 		error(eval, expr, self, obj, ERROR_NOTINT);
 	size = simp_getsignum(obj);
@@ -903,21 +1377,19 @@ f_makevector(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_map(Eval *eval, Simp *vector, Simp self, Simp expr, Simp env, Simp args)
+f_map(Eval *eval, Simp *vector, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp prod, obj;
-	SimpSiz i, j, n, size, nargs;
+	SimpSiz i, j, n, size, base;
 
-	(void)env;
-	nargs = simp_getsize(args);
 	if (nargs < 2)
 		error(eval, expr, self, simp_void(), ERROR_NARGS);
-	prod = simp_getvectormemb(args, 0);
+	prod = args[0];
 	if (!simp_isprocedure(prod))
 		error(eval, expr, self, prod, ERROR_NOTPROC);
 	size = 0;
 	for (i = 1; i < nargs; i++) {
-		obj = simp_getvectormemb(args, i);
+		obj = args[i];
 		if (!simp_isvector(obj))
 			error(eval, expr, self, obj, ERROR_NOTVECTOR);
 		n = simp_getsize(obj);
@@ -929,39 +1401,37 @@ f_map(Eval *eval, Simp *vector, Simp self, Simp expr, Simp env, Simp args)
 			error(eval, expr, self, simp_void(), ERROR_MAP);
 		}
 	}
-	if (!simp_makevector(eval->ctx, &expr, nargs))
-		memerror(eval);
 	if (!simp_makevector(eval->ctx, vector, size))
 		memerror(eval);
-	simp_setvector(expr, 0, prod);
+	/* the stack may move under apply(), so index the arguments */
+	base = args - eval->stack;
 	for (i = 0; i < size; i++) {
+		reserve(eval, nargs);
+		eval->stack[eval->sp++] = prod;
 		for (j = 1; j < nargs; j++) {
-			obj = simp_getvectormemb(args, j);
-			obj = simp_getvectormemb(obj, i);
-			simp_setvector(expr, j, obj);
+			obj = eval->stack[base + j];
+			eval->stack[eval->sp++] = simp_getvectormemb(obj, i);
 		}
-		obj = simp_eval(eval, expr, simp_nulenv());
-		simp_setvector(*vector, i, obj);
+		obj = apply(eval, expr, env, nargs - 1);
+		simp_setvector(eval->ctx, *vector, i, obj);
 	}
 }
 
 static void
-f_mapstring(Eval *eval, Simp *string, Simp self, Simp expr, Simp env, Simp args)
+f_mapstring(Eval *eval, Simp *string, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	Simp newexpr, prod, obj;
-	SimpSiz i, j, n, size, nargs;
+	Simp prod, obj;
+	SimpSiz i, j, n, size, base;
 	unsigned char byte;
 
-	(void)env;
-	nargs = simp_getsize(args);
 	if (nargs < 2)
 		error(eval, expr, self, simp_void(), ERROR_NARGS);
-	prod = simp_getvectormemb(args, 0);
+	prod = args[0];
 	if (!simp_isprocedure(prod))
 		error(eval, expr, self, prod, ERROR_NOTPROC);
 	size = 0;
 	for (i = 1; i < nargs; i++) {
-		obj = simp_getvectormemb(args, i);
+		obj = args[i];
 		if (!simp_isstring(obj))
 			error(eval, expr, self, obj, ERROR_NOTSTRING);
 		n = simp_getsize(obj);
@@ -973,20 +1443,21 @@ f_mapstring(Eval *eval, Simp *string, Simp self, Simp expr, Simp env, Simp args)
 			error(eval, expr, self, simp_void(), ERROR_MAP);
 		}
 	}
-	if (!simp_makevector(eval->ctx, &newexpr, nargs))
-		memerror(eval);
 	if (!simp_makestring(eval->ctx, string, NULL, size))
 		memerror(eval);
-	simp_setvector(newexpr, 0, prod);
+	/* the stack may move under apply(), so index the arguments */
+	base = args - eval->stack;
 	for (i = 0; i < size; i++) {
+		reserve(eval, nargs);
+		eval->stack[eval->sp++] = prod;
 		for (j = 1; j < nargs; j++) {
-			obj = simp_getvectormemb(args, j);
+			obj = eval->stack[base + j];
 			byte = simp_getstringmemb(obj, i);
 			if (!simp_makebyte(eval->ctx, &obj, byte))
 				memerror(eval);
-			simp_setvector(newexpr, j, obj);
+			eval->stack[eval->sp++] = obj;
 		}
-		obj = simp_eval(eval, newexpr, simp_nulenv());
+		obj = apply(eval, expr, env, nargs - 1);
 		if (!simp_isbyte(obj))
 			error(eval, expr, self, obj, ERROR_NOTBYTE);
 		simp_setstring(*string, i, simp_getbyte(obj));
@@ -994,29 +1465,27 @@ f_mapstring(Eval *eval, Simp *string, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_member(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_member(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	Simp newexpr, pred, ref, obj, vector;
+	Simp pred, ref, obj, vector;
 	SimpSiz i, size;
 
-	(void)env;
+	(void)nargs;
 	*ret = simp_false();
-	pred = simp_getvectormemb(args, 0);
-	ref = simp_getvectormemb(args, 1);
-	vector = simp_getvectormemb(args, 2);
+	pred = args[0];
+	ref = args[1];
+	vector = args[2];
 	if (!simp_isprocedure(pred))
 		error(eval, expr, self, pred, ERROR_NOTPROC);
 	if (!simp_isvector(vector))
 		error(eval, expr, self, vector, ERROR_NOTVECTOR);
 	size = simp_getsize(vector);
-	if (!simp_makevector(eval->ctx, &newexpr, 3))
-		memerror(eval);
-	simp_setvector(newexpr, 0, pred);
-	simp_setvector(newexpr, 1, ref);
 	for (i = 0; i < size; i++) {
-		obj = simp_getvectormemb(vector, i);
-		simp_setvector(newexpr, 2, obj);
-		obj = simp_eval(eval, newexpr, simp_nulenv());
+		reserve(eval, 3);
+		eval->stack[eval->sp++] = pred;
+		eval->stack[eval->sp++] = ref;
+		eval->stack[eval->sp++] = simp_getvectormemb(vector, i);
+		obj = apply(eval, expr, env, 2);
 		if (simp_istrue(obj)) {
 			*ret = simp_slicevector(vector, i, size - i);
 			break;
@@ -1025,17 +1494,16 @@ f_member(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_multiply(Eval *eval, Simp *prod, Simp self, Simp expr, Simp env, Simp args)
+f_multiply(Eval *eval, Simp *prod, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	SimpSiz nargs, i;
+	SimpSiz i;
 	Simp obj;
 
 	(void)env;
-	nargs = simp_getsize(args);
 	if (!simp_makesignum(eval->ctx, prod, 1))
 		memerror(eval);
 	for (i = 0; i < nargs; i++) {
-		obj = simp_getvectormemb(args, i);
+		obj = args[i];
 		if (!simp_isnum(obj))
 			error(eval, expr, self, obj, ERROR_NOTINT);
 		if (!simp_arithmul(eval->ctx, prod, *prod, obj))
@@ -1044,16 +1512,16 @@ f_multiply(Eval *eval, Simp *prod, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_newline(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_newline(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp port;
 
 	(void)ret;
 	(void)env;
 	port = eval->oport;
-	switch (simp_getsize(args)) {
+	switch (nargs) {
 	case 1:
-		port = simp_getvectormemb(args, 0);
+		port = args[0];
 		/* FALLTHROUGH */
 	case 0:
 		break;
@@ -1067,7 +1535,7 @@ f_newline(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_not(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_not(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp obj;
 
@@ -1075,29 +1543,32 @@ f_not(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 	(void)self;
 	(void)expr;
 	(void)env;
+	(void)nargs;
 	*ret = simp_false();
-	obj = simp_getvectormemb(args, 0);
+	obj = args[0];
 	if (simp_isfalse(obj))
 		*ret = simp_true();
 }
 
 static void
-f_nullp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_nullp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)self;
 	(void)expr;
 	(void)env;
+	(void)nargs;
 	typepred(args, ret, simp_isnil);
 }
 
 static void
-f_numberp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_numberp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)self;
 	(void)expr;
 	(void)env;
+	(void)nargs;
 	typepred(args, ret, simp_issignum);
 }
 
@@ -1109,8 +1580,7 @@ f_or(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 	nargs = simp_getsize(args);
 	*ret = simp_true();
 	for (i = 0; i < nargs; i++) {
-		*ret = simp_getvectormemb(args, i);
-		*ret = simp_eval(eval, *ret, env);
+		*ret = evalmemb(eval, args, i, env);
 		if (simp_isvoid(*ret))
 			error(eval, expr, self, simp_void(), ERROR_VOID);
 		if (simp_istrue(*ret)) {
@@ -1120,22 +1590,24 @@ f_or(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_portp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_portp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)self;
 	(void)expr;
 	(void)env;
+	(void)nargs;
 	typepred(args, ret, simp_isport);
 }
 
 static void
-f_procedurep(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_procedurep(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)self;
 	(void)expr;
 	(void)env;
+	(void)nargs;
 	typepred(args, ret, simp_isprocedure);
 }
 
@@ -1153,7 +1625,7 @@ static void
 f_quasiquote(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 {
 	Simp vect, fst, obj, oldvect;
-	SimpSiz size, n, i, j;
+	SimpSiz size, n, i, j, nroots;
 
 	(void)eval;
 	(void)self;
@@ -1169,12 +1641,14 @@ f_quasiquote(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 	if (simp_issame(fst, eval->aux[AUX_UNQUOTE])) {
 		if (size != 2)
 			error(eval, expr, self, simp_void(), ERROR_NARGS);
-		obj = simp_getvectormemb(vect, 1);
-		*ret = simp_eval(eval, obj, env);
+		*ret = evalmemb(eval, vect, 1, env);
 		return;
 	}
 	if (!simp_makevector(eval->ctx, ret, size))
 		memerror(eval);
+	nroots = simp_gcgetroots(eval->ctx);
+	gcprotect(eval, &obj);
+	obj = simp_nil();
 	for (i = j = 0; i < size; j++) {
 		obj = simp_getvectormemb(vect, j);
 		if (simp_isvector(obj) && (n = simp_getsize(obj)) > 0 &&
@@ -1190,28 +1664,29 @@ f_quasiquote(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 			size--;
 			if (!simp_makevector(eval->ctx, ret, size + n))
 				memerror(eval);
-			simp_cpyvector(*ret, oldvect);
-			simp_cpyvector(simp_slicevector(*ret, i, n), obj);
+			simp_cpyvector(eval->ctx, *ret, oldvect);
+			simp_cpyvector(eval->ctx, simp_slicevector(*ret, i, n), obj);
 			size += n;
 			i += n;
 		} else {
 			args = simp_slicevector(vect, j, 1);
 			f_quasiquote(eval, &obj, self, expr, env, args);
-			simp_setvector(*ret, i++, obj);
+			simp_setvector(eval->ctx, *ret, i++, obj);
 		}
 	}
+	simp_gcsetroots(eval->ctx, nroots);
 }
 
 static void
-f_read(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_read(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp port;
 
 	(void)env;
 	port = eval->iport;
-	switch (simp_getsize(args)) {
+	switch (nargs) {
 	case 1:
-		port = simp_getvectormemb(args, 0);
+		port = args[0];
 		/* FALLTHROUGH */
 	case 0:
 		break;
@@ -1221,7 +1696,7 @@ f_read(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 	}
 	if (!simp_isport(port))
 		error(eval, expr, self, port, ERROR_NOTPORT);
-	if (!simp_read(eval->ctx, ret, port))
+	if (!simp_readdatum(eval->ctx, ret, port))
 		error(eval, expr, self, simp_void(), ERROR_READ);
 }
 
@@ -1232,22 +1707,22 @@ f_redefine(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 
 	(void)ret;
 	var = simp_getvectormemb(args, 0);
-	val = simp_getvectormemb(args, 1);
 	if (!simp_issymbol(var))
 		error(eval, expr, self, var, ERROR_NOTSYM);
-	val = simp_eval(eval, val, env);
+	val = evalmemb(eval, args, 1, env);
 	envset(eval, expr, env, var, val, false);
 }
 
 static void
-f_remainder(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_remainder(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	SimpInt d;
 	Simp a, b;
 
 	(void)env;
-	a = simp_getvectormemb(args, 0);
-	b = simp_getvectormemb(args, 1);
+	(void)nargs;
+	a = args[0];
+	b = args[1];
 	if (!simp_issignum(a))
 		error(eval, expr, self, a, ERROR_NOTINT);
 	if (!simp_issignum(b))
@@ -1255,15 +1730,61 @@ f_remainder(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 	d = simp_getsignum(b);
 	if (d == 0)
 		error(eval, expr, self, simp_void(), ERROR_DIVZERO);
-	d = simp_getsignum(a) % d;
+	/* LLONG_MIN % -1 traps on some machines; the remainder is 0 anyway */
+	d = (d == -1) ? 0 : simp_getsignum(a) % d;
 	if (!simp_makesignum(eval->ctx, ret, d))
 		memerror(eval);
 }
 
 static void
-f_samep(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_runtimestats(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	SimpSiz nargs, i;
+	static const char *typenames[] = {
+#define X(n, s, h) [n] = s,
+		TYPES
+#undef  X
+	};
+	SimpStats *stats;
+	Simp num, allocs;
+	SimpSiz i, n;
+
+	(void)self;
+	(void)expr;
+	(void)env;
+	(void)args;
+	(void)nargs;
+	stats = simp_gcstats(eval->ctx);
+	n = 0;
+#define X(s, f) n++;
+	STATS
+#undef  X
+	if (!simp_makevector(eval->ctx, ret, n + 3))
+		memerror(eval);
+	i = 0;
+#define X(s, f)                                                 \
+	if (!simp_makesignum(eval->ctx, &num, stats->f))        \
+		memerror(eval);                                 \
+	simp_setvector(eval->ctx, *ret, i++, statpair(eval, s, num));
+	STATS
+#undef  X
+	num = statcounts(eval, stats->pauses, SIMP_NPAUSES);
+	simp_setvector(eval->ctx, *ret, i++, statpair(eval, "pauses", num));
+	num = statcounts(eval, stats->loads, SIMP_NLOADS);
+	simp_setvector(eval->ctx, *ret, i++, statpair(eval, "symbol-bucket-loads", num));
+	if (!simp_makevector(eval->ctx, &allocs, SIMP_NTYPES))
+		memerror(eval);
+	for (n = 0; n < SIMP_NTYPES; n++) {
+		if (!simp_makesignum(eval->ctx, &num, stats->allocs[n]))
+			memerror(eval);
+		simp_setvector(eval->ctx, allocs, n, statpair(eval, typenames[n], num));
+	}
+	simp_setvector(eval->ctx, *ret, i++, statpair(eval, "allocations", allocs));
+}
+
+static void
+f_samep(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
+{
+	SimpSiz i;
 	Simp next, prev;
 
 	(void)eval;
@@ -1271,9 +1792,8 @@ f_samep(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 	(void)expr;
 	(void)env;
 	*ret = simp_true();
-	nargs = simp_getsize(args);
 	for (i = 0; i < nargs; i++, prev = next) {
-		next = simp_getvectormemb(args, i);
+		next = args[i];
 		if (i == 0)
 			continue;
 		if (!simp_issame(prev, next)) {
@@ -1284,23 +1804,22 @@ f_samep(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_slicevector(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_slicevector(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp vector, obj;
-	SimpSiz nargs, from, size, capacity;
+	SimpSiz from, size, capacity;
 
 	(void)eval;
 	(void)env;
-	nargs = simp_getsize(args);
 	if (nargs < 1 || nargs > 3)
 		error(eval, expr, self, simp_void(), ERROR_NARGS);
-	vector = simp_getvectormemb(args, 0);
+	vector = args[0];
 	if (!simp_isvector(vector))
 		error(eval, expr, self, vector, ERROR_NOTVECTOR);
 	from = 0;
 	capacity = simp_getsize(vector);
 	if (nargs > 1) {
-		obj = simp_getvectormemb(args, 1);
+		obj = args[1];
 		if (!simp_issignum(obj)) {
 			error(eval, expr, self, obj, ERROR_NOTINT);
 		}
@@ -1311,7 +1830,7 @@ f_slicevector(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 	}
 	size = capacity - from;
 	if (nargs > 2) {
-		obj = simp_getvectormemb(args, 2);
+		obj = args[2];
 		if (!simp_issignum(obj)) {
 			error(eval, expr, self, obj, ERROR_NOTINT);
 		}
@@ -1327,24 +1846,23 @@ f_slicevector(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_slicestring(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_slicestring(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp string, obj;
-	SimpSiz nargs, from, size, capacity;
+	SimpSiz from, size, capacity;
 
 	(void)eval;
 	(void)env;
-	nargs = simp_getsize(args);
 	if (nargs < 1 || nargs > 3)
 		error(eval, expr, self, simp_void(), ERROR_NARGS);
-	string = simp_getvectormemb(args, 0);
+	string = args[0];
 	if (!simp_isstring(string))
 		error(eval, expr, self, string, ERROR_NOTSTRING);
 	from = 0;
 	size = simp_getsize(string);
 	capacity = simp_getsize(string);
 	if (nargs > 1) {
-		obj = simp_getvectormemb(args, 1);
+		obj = args[1];
 		if (!simp_issignum(obj)) {
 			error(eval, expr, self, obj, ERROR_NOTINT);
 		}
@@ -1354,7 +1872,7 @@ f_slicestring(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 		}
 	}
 	if (nargs > 2) {
-		obj = simp_getvectormemb(args, 2);
+		obj = args[2];
 		if (!simp_issignum(obj)) {
 			error(eval, expr, self, obj, ERROR_NOTINT);
 		}
@@ -1370,17 +1888,16 @@ f_slicestring(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_subtract(Eval *eval, Simp *diff, Simp self, Simp expr, Simp env, Simp args)
+f_subtract(Eval *eval, Simp *diff, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	SimpSiz nargs, i;
+	SimpSiz i;
 	Simp obj;
 
 	(void)env;
-	nargs = simp_getsize(args);
 	if (!simp_makesignum(eval->ctx, diff, 0))
 		memerror(eval);
 	for (i = 0; i < nargs; i++) {
-		obj = simp_getvectormemb(args, i);
+		obj = args[i];
 		if (!simp_isnum(obj))
 			error(eval, expr, self, obj, ERROR_NOTNUM);
 		if (nargs == 1 || i > 0) {
@@ -1394,17 +1911,16 @@ f_subtract(Eval *eval, Simp *diff, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_string(Eval *eval, Simp *string, Simp self, Simp expr, Simp env, Simp args)
+f_string(Eval *eval, Simp *string, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp obj;
-	SimpSiz nargs, i;
+	SimpSiz i;
 
 	(void)env;
-	nargs = simp_getsize(args);
 	if (!simp_makestring(eval->ctx, string, NULL, nargs))
 		memerror(eval);
 	for (i = 0; i < nargs; i++) {
-		obj = simp_getvectormemb(args, i);
+		obj = args[i];
 		if (!simp_isbyte(obj))
 			error(eval, expr, self, obj, ERROR_NOTBYTE);
 		simp_setstring(*string, i, simp_getbyte(obj));
@@ -1412,16 +1928,15 @@ f_string(Eval *eval, Simp *string, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_stringcat(Eval *eval, Simp *string, Simp self, Simp expr, Simp env, Simp args)
+f_stringcat(Eval *eval, Simp *string, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp obj;
-	SimpSiz nargs, size, n, i;
+	SimpSiz size, n, i;
 
 	(void)env;
-	nargs = simp_getsize(args);
 	size = 0;
 	for (i = 0; i < nargs; i++) {
-		obj = simp_getvectormemb(args, i);
+		obj = args[i];
 		if (!simp_isstring(obj))
 			error(eval, expr, self, obj, ERROR_NOTSTRING);
 		size += simp_getsize(obj);
@@ -1429,7 +1944,7 @@ f_stringcat(Eval *eval, Simp *string, Simp self, Simp expr, Simp env, Simp args)
 	if (!simp_makestring(eval->ctx, string, NULL, size))
 		memerror(eval);
 	for (size = i = 0; i < nargs; i++) {
-		obj = simp_getvectormemb(args, i);
+		obj = args[i];
 		n = simp_getsize(obj);
 		simp_cpystring(
 			simp_slicestring(*string, size, n),
@@ -1440,15 +1955,16 @@ f_stringcat(Eval *eval, Simp *string, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_stringcpy(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_stringcpy(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp dst, src;
 	SimpSiz dstsiz, srcsiz;
 
 	(void)ret;
 	(void)env;
-	dst = simp_getvectormemb(args, 0);
-	src = simp_getvectormemb(args, 1);
+	(void)nargs;
+	dst = args[0];
+	src = args[1];
 	if (!simp_isstring(dst))
 		error(eval, expr, self, dst, ERROR_NOTSTRING);
 	if (!simp_isstring(src))
@@ -1461,13 +1977,14 @@ f_stringcpy(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_stringdup(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_stringdup(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp obj;
 	SimpSiz len;
 
 	(void)env;
-	obj = simp_getvectormemb(args, 0);
+	(void)nargs;
+	obj = args[0];
 	if (!simp_isstring(obj))
 		error(eval, expr, self, obj, ERROR_NOTSTRING);
 	len = simp_getsize(obj);
@@ -1476,16 +1993,15 @@ f_stringdup(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_stringge(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_stringge(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	SimpSiz nargs, i;
+	SimpSiz i;
 	Simp next, prev;
 
 	*ret = simp_true();
 	(void)env;
-	nargs = simp_getsize(args);
 	for (i = 0; i < nargs; i++, prev = next) {
-		next = simp_getvectormemb(args, i);
+		next = args[i];
 		if (!simp_isstring(next))
 			error(eval, expr, self, next, ERROR_NOTSTRING);
 		if (i == 0)
@@ -1498,16 +2014,15 @@ f_stringge(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_stringgt(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_stringgt(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	SimpSiz nargs, i;
+	SimpSiz i;
 	Simp next, prev;
 
 	(void)env;
 	*ret = simp_true();
-	nargs = simp_getsize(args);
 	for (i = 0; i < nargs; i++, prev = next) {
-		next = simp_getvectormemb(args, i);
+		next = args[i];
 		if (!simp_isstring(next))
 			error(eval, expr, self, next, ERROR_NOTSTRING);
 		if (i == 0)
@@ -1520,16 +2035,15 @@ f_stringgt(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_stringle(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_stringle(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	SimpSiz nargs, i;
+	SimpSiz i;
 	Simp next, prev;
 
 	(void)env;
 	*ret = simp_true();
-	nargs = simp_getsize(args);
 	for (i = 0; i < nargs; i++, prev = next) {
-		next = simp_getvectormemb(args, i);
+		next = args[i];
 		if (!simp_isstring(next))
 			error(eval, expr, self, next, ERROR_NOTSTRING);
 		if (i == 0)
@@ -1542,16 +2056,15 @@ f_stringle(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_stringlt(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_stringlt(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	SimpSiz nargs, i;
+	SimpSiz i;
 	Simp next, prev;
 
 	(void)env;
 	*ret = simp_true();
-	nargs = simp_getsize(args);
 	for (i = 0; i < nargs; i++, prev = next) {
-		next = simp_getvectormemb(args, i);
+		next = args[i];
 		if (!simp_isstring(next))
 			error(eval, expr, self, next, ERROR_NOTSTRING);
 		if (i == 0)
@@ -1564,13 +2077,14 @@ f_stringlt(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_stringlen(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_stringlen(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	SimpInt size;
 	Simp obj;
 
 	(void)env;
-	obj = simp_getvectormemb(args, 0);
+	(void)nargs;
+	obj = args[0];
 	if (!simp_isstring(obj))
 		error(eval, expr, self, obj, ERROR_NOTSTRING);
 	size = simp_getsize(obj);
@@ -1579,7 +2093,7 @@ f_stringlen(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_stringref(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_stringref(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	SimpSiz size;
 	SimpInt pos;
@@ -1587,8 +2101,9 @@ f_stringref(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 	unsigned u;
 
 	(void)env;
-	a = simp_getvectormemb(args, 0);
-	b = simp_getvectormemb(args, 1);
+	(void)nargs;
+	a = args[0];
+	b = args[1];
 	if (!simp_isstring(a))
 		error(eval, expr, self, a, ERROR_NOTSTRING);
 	if (!simp_issignum(b))
@@ -1603,24 +2118,26 @@ f_stringref(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_stringp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_stringp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)self;
 	(void)expr;
 	(void)env;
+	(void)nargs;
 	typepred(args, ret, simp_isstring);
 }
 
 static void
-f_stringvector(Eval *eval, Simp *vector, Simp self, Simp expr, Simp env, Simp args)
+f_stringvector(Eval *eval, Simp *vector, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp str, byte;
 	SimpSiz i, size;
 	unsigned char u;
 
 	(void)env;
-	str = simp_getvectormemb(args, 0);
+	(void)nargs;
+	str = args[0];
 	if (!simp_isstring(str))
 		error(eval, expr, self, str, ERROR_NOTSTRING);
 	size = simp_getsize(str);
@@ -1630,12 +2147,12 @@ f_stringvector(Eval *eval, Simp *vector, Simp self, Simp expr, Simp env, Simp ar
 		u = simp_getstringmemb(str, i);
 		if (!simp_makebyte(eval->ctx, &byte, u))
 			memerror(eval);
-		simp_setvector(*vector, i, byte);
+		simp_setvector(eval->ctx, *vector, i, byte);
 	}
 }
 
 static void
-f_stringset(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_stringset(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp str, pos, val;
 	SimpSiz size;
@@ -1644,9 +2161,10 @@ f_stringset(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 
 	(void)ret;
 	(void)env;
-	str = simp_getvectormemb(args, 0);
-	pos = simp_getvectormemb(args, 1);
-	val = simp_getvectormemb(args, 2);
+	(void)nargs;
+	str = args[0];
+	pos = args[1];
+	val = args[2];
 	if (!simp_isstring(str))
 		error(eval, expr, self, str, ERROR_NOTSTRING);
 	if (!simp_issignum(pos))
@@ -1673,47 +2191,51 @@ f_true(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_truep(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_truep(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)self;
 	(void)expr;
 	(void)env;
+	(void)nargs;
 	typepred(args, ret, simp_istrue);
 }
 
 static void
-f_symbolp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_symbolp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)self;
 	(void)expr;
 	(void)env;
+	(void)nargs;
 	typepred(args, ret, simp_issymbol);
 }
 
 static void
-f_vector(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_vector(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
-	(void)eval;
+	SimpSiz i;
+
 	(void)self;
 	(void)expr;
-	(void)ret;
 	(void)env;
-	*ret = args;
+	if (!simp_makevector(eval->ctx, ret, nargs))
+		memerror(eval);
+	for (i = 0; i < nargs; i++)
+		simp_setvector(eval->ctx, *ret, i, args[i]);
 }
 
 static void
-f_vectorcat(Eval *eval, Simp *vector, Simp self, Simp expr, Simp env, Simp args)
+f_vectorcat(Eval *eval, Simp *vector, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp obj;
-	SimpSiz nargs, size, n, i;
+	SimpSiz size, n, i;
 
 	(void)env;
-	nargs = simp_getsize(args);
 	size = 0;
 	for (i = 0; i < nargs; i++) {
-		obj = simp_getvectormemb(args, i);
+		obj = args[i];
 		if (!simp_isvector(obj))
 			error(eval, expr, self, obj, ERROR_NOTVECTOR);
 		size += simp_getsize(obj);
@@ -1721,9 +2243,9 @@ f_vectorcat(Eval *eval, Simp *vector, Simp self, Simp expr, Simp env, Simp args)
 	if (!simp_makevector(eval->ctx, vector, size))
 		memerror(eval);
 	for (size = i = 0; i < nargs; i++) {
-		obj = simp_getvectormemb(args, i);
+		obj = args[i];
 		n = simp_getsize(obj);
-		simp_cpyvector(
+		simp_cpyvector(eval->ctx, 
 			simp_slicevector(*vector, size, n),
 			obj
 		);
@@ -1732,15 +2254,16 @@ f_vectorcat(Eval *eval, Simp *vector, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_vectorcpy(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_vectorcpy(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp dst, src;
 	SimpSiz dstsiz, srcsiz;
 
 	(void)ret;
 	(void)env;
-	dst = simp_getvectormemb(args, 0);
-	src = simp_getvectormemb(args, 1);
+	(void)nargs;
+	dst = args[0];
+	src = args[1];
 	if (!simp_isvector(dst))
 		error(eval, expr, self, dst, ERROR_NOTVECTOR);
 	if (!simp_isvector(src))
@@ -1749,37 +2272,37 @@ f_vectorcpy(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 	srcsiz = simp_getsize(src);
 	if (srcsiz > dstsiz)
 		error(eval, expr, self, simp_void(), ERROR_NOTFIT);
-	simp_cpyvector(dst, src);
+	simp_cpyvector(eval->ctx, dst, src);
 }
 
 static void
-f_vectordup(Eval *eval, Simp *dst, Simp self, Simp expr, Simp env, Simp args)
+f_vectordup(Eval *eval, Simp *dst, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp src;
 	SimpSiz len;
 
 	(void)env;
-	src = simp_getvectormemb(args, 0);
+	(void)nargs;
+	src = args[0];
 	if (!simp_isvector(src))
 		error(eval, expr, self, src, ERROR_NOTVECTOR);
 	len = simp_getsize(src);
 	if (!simp_makevector(eval->ctx, dst, len))
 		memerror(eval);
-	simp_cpyvector(*dst, src);
+	simp_cpyvector(eval->ctx, *dst, src);
 }
 
 static void
-f_vectoreqv(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_vectoreqv(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp a, b;
 	Simp next, prev;
-	SimpSiz nargs, newsize, oldsize, i, j;
+	SimpSiz newsize, oldsize, i, j;
 
 	(void)eval;
 	(void)env;
-	nargs = simp_getsize(args);
 	for (i = 0; i < nargs; i++, prev = next, oldsize = newsize) {
-		next = simp_getvectormemb(args, i);
+		next = args[i];
 		if (!simp_isvector(next))
 			error(eval, expr, self, next, ERROR_NOTVECTOR);
 		newsize = simp_getsize(next);
@@ -1802,17 +2325,18 @@ f_vectoreqv(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_vectorp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_vectorp(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	(void)eval;
 	(void)self;
 	(void)expr;
 	(void)env;
+	(void)nargs;
 	typepred(args, ret, simp_isvector);
 }
 
 static void
-f_vectorset(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_vectorset(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp vector, pos, val;
 	SimpSiz size;
@@ -1820,9 +2344,10 @@ f_vectorset(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 
 	(void)ret;
 	(void)env;
-	vector = simp_getvectormemb(args, 0);
-	pos = simp_getvectormemb(args, 1);
-	val = simp_getvectormemb(args, 2);
+	(void)nargs;
+	vector = args[0];
+	pos = args[1];
+	val = args[2];
 	if (!simp_isvector(vector))
 		error(eval, expr, self, vector, ERROR_NOTVECTOR);
 	if (!simp_issignum(pos))
@@ -1831,17 +2356,18 @@ f_vectorset(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 	n = simp_getsignum(pos);
 	if (n < 0 || n >= (SimpInt)size)
 		error(eval, expr, self, pos, ERROR_RANGE);
-	simp_setvector(vector, n, val);
+	simp_setvector(eval->ctx, vector, n, val);
 }
 
 static void
-f_vectorlen(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_vectorlen(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	SimpInt size;
 	Simp obj;
 
 	(void)env;
-	obj = simp_getvectormemb(args, 0);
+	(void)nargs;
+	obj = args[0];
 	if (!simp_isvector(obj))
 		error(eval, expr, self, obj, ERROR_NOTVECTOR);
 	size = simp_getsize(obj);
@@ -1850,7 +2376,7 @@ f_vectorlen(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_vectorref(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_vectorref(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	SimpSiz size;
 	SimpInt pos;
@@ -1858,8 +2384,9 @@ f_vectorref(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 
 	(void)eval;
 	(void)env;
-	a = simp_getvectormemb(args, 0);
-	b = simp_getvectormemb(args, 1);
+	(void)nargs;
+	a = args[0];
+	b = args[1];
 	if (!simp_isvector(a))
 		error(eval, expr, self, a, ERROR_NOTVECTOR);
 	if (!simp_issignum(b))
@@ -1872,14 +2399,15 @@ f_vectorref(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 }
 
 static void
-f_vectorrev(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_vectorrev(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	SimpSiz i, n, size;
 	Simp obj, beg, end;
 
 	(void)eval;
 	(void)env;
-	obj = simp_getvectormemb(args, 0);
+	(void)nargs;
+	obj = args[0];
 	if (!simp_isvector(obj))
 		error(eval, expr, self, obj, ERROR_NOTVECTOR);
 	size = simp_getsize(obj);
@@ -1887,20 +2415,21 @@ f_vectorrev(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
 		n = size - i - 1;
 		beg = simp_getvectormemb(obj, i);
 		end = simp_getvectormemb(obj, n);
-		simp_setvector(obj, i, end);
-		simp_setvector(obj, n, beg);
+		simp_setvector(eval->ctx, obj, i, end);
+		simp_setvector(eval->ctx, obj, n, beg);
 	}
 	*ret = obj;
 }
 
 static void
-f_vectorrevnew(Eval *eval, Simp *vector, Simp self, Simp expr, Simp env, Simp args)
+f_vectorrevnew(Eval *eval, Simp *vector, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	SimpSiz i, n, size;
 	Simp obj, beg, end;
 
 	(void)env;
-	obj = simp_getvectormemb(args, 0);
+	(void)nargs;
+	obj = args[0];
 	if (!simp_isvector(obj))
 		error(eval, expr, self, obj, ERROR_NOTVECTOR);
 	size = simp_getsize(obj);
@@ -1910,29 +2439,29 @@ f_vectorrevnew(Eval *eval, Simp *vector, Simp self, Simp expr, Simp env, Simp ar
 		n = size - i - 1;
 		beg = simp_getvectormemb(obj, i);
 		end = simp_getvectormemb(obj, n);
-		simp_setvector(*vector, i, end);
-		simp_setvector(*vector, n, beg);
+		simp_setvector(eval->ctx, *vector, i, end);
+		simp_setvector(eval->ctx, *vector, n, beg);
 	}
 	if (size % 2 == 1) {
 		obj = simp_getvectormemb(obj, i);
-		simp_setvector(*vector, i, obj);
+		simp_setvector(eval->ctx, *vector, i, obj);
 	}
 }
 
 static void
-f_write(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp args)
+f_write(Eval *eval, Simp *ret, Simp self, Simp expr, Simp env, Simp *args, SimpSiz nargs)
 {
 	Simp obj, port;
 
 	(void)ret;
 	(void)env;
 	port = eval->oport;
-	switch (simp_getsize(args)) {
+	switch (nargs) {
 	case 2:
-		port = simp_getvectormemb(args, 1);
+		port = args[1];
 		/* FALLTHROUGH */
 	case 1:
-		obj = simp_getvectormemb(args, 0);
+		obj = args[0];
 		break;
 	default:
 		error(eval, expr, self, simp_void(), ERROR_NARGS);
@@ -1947,10 +2476,11 @@ bool
 simp_environmentnew(Simp ctx, Simp *env)
 {
 	static Builtin funcs[] = {
-#define X(s, p, a, v) { \
+#define X(s, p, a, v, f) { \
 	.type = BLTIN_ROUTINE, \
 	.name = (unsigned char *)s, \
 	.fun = &p, \
+	.fix = f, \
 	.nargs = a, \
 	.variadic = v, \
 	.namelen = sizeof(s)-1 },
@@ -1961,6 +2491,7 @@ simp_environmentnew(Simp ctx, Simp *env)
 	.type = e, \
 	.name = (unsigned char *)s, \
 	.fun = NULL, \
+	.fix = NULL, \
 	.nargs = a, \
 	.variadic = v, \
 	.namelen = sizeof(s)-1 },
@@ -1971,7 +2502,7 @@ simp_environmentnew(Simp ctx, Simp *env)
 #define X(s, p, a, v) { \
 	.type = BLTIN_ROUTINE, \
 	.name = (unsigned char *)s, \
-	.fun = &p, \
+	.macro = &p, \
 	.nargs = a, \
 	.variadic = v, \
 	.namelen = sizeof(s)-1 },
@@ -1981,7 +2512,7 @@ simp_environmentnew(Simp ctx, Simp *env)
 #define X(s, e, a, v) { \
 	.type = e, \
 	.name = (unsigned char *)s, \
-	.fun = NULL, \
+	.macro = NULL, \
 	.nargs = a, \
 	.variadic = v, \
 	.namelen = sizeof(s)-1 },
@@ -1991,7 +2522,7 @@ simp_environmentnew(Simp ctx, Simp *env)
 #define X(s, e) { \
 	.type = BLTIN_ROUTINE, \
 	.name = (unsigned char *)s, \
-	.fun = &f_auxiliary, \
+	.macro = &f_auxiliary, \
 	.nargs = 0, \
 	.variadic = true, \
 	.namelen = sizeof(s)-1 },
@@ -2007,6 +2538,9 @@ simp_environmentnew(Simp ctx, Simp *env)
 		/* fill initial environment with builtin macros */
 		if (!simp_makesymbol(ctx, &var, macros[i].name, macros[i].namelen))
 			return false;
+		if (!simp_pinsymbol(ctx, var))
+			return false;
+		macros[i].self = var;
 		if (!simp_makebuiltin(ctx, &val, simp_nil(), &macros[i]))
 			return false;
 		if (!simp_envdefine(ctx, *env, var, val, true))
@@ -2016,6 +2550,9 @@ simp_environmentnew(Simp ctx, Simp *env)
 		/* fill initial environment with builtin procedures */
 		if (!simp_makesymbol(ctx, &var, funcs[i].name, funcs[i].namelen))
 			return false;
+		if (!simp_pinsymbol(ctx, var))
+			return false;
+		funcs[i].self = var;
 		if (!simp_makebuiltin(ctx, &val, simp_nil(), &funcs[i]))
 			return false;
 		if (!simp_envdefine(ctx, *env, var, val, false))
@@ -2024,226 +2561,1205 @@ simp_environmentnew(Simp ctx, Simp *env)
 	return true;
 }
 
+static Code *
+getcode(Simp code)
+{
+	return (Code *)simp_getstring(simp_getvectormemb(code, CODE_WORDS));
+}
+
+static Site *
+getsites(Code *code)
+{
+	return (Site *)(code + 1);
+}
+
+static Word *
+getwords(Code *code)
+{
+	return (Word *)(getsites(code) + code->nsites);
+}
+
+static void
+emit(Compiler *c, Word word)
+{
+	Eval *eval;
+	Word *words;
+	SimpSiz size;
+
+	eval = c->eval;
+	if (eval->nwords == eval->maxwords) {
+		size = eval->maxwords > 0 ? eval->maxwords * 2 : WORDS_SIZE;
+		if ((words = realloc(eval->words, size * sizeof(*words))) == NULL)
+			memerror(eval);
+		eval->words = words;
+		eval->maxwords = size;
+	}
+	eval->words[eval->nwords++] = word;
+}
+
+static Word
+constant(Compiler *c, Simp obj)
+{
+	Eval *eval;
+	Simp *consts;
+	SimpSiz size;
+
+	eval = c->eval;
+	if (eval->nconsts == eval->maxconsts) {
+		size = eval->maxconsts > 0 ? eval->maxconsts * 2 : WORDS_SIZE;
+		if ((consts = realloc(eval->consts, size * sizeof(*consts))) == NULL)
+			memerror(eval);
+		eval->consts = consts;
+		eval->maxconsts = size;
+	}
+	eval->consts[eval->nconsts++] = obj;
+	return eval->nconsts - 1 - c->consts;
+}
+
+static Word
+label(Compiler *c)
+{
+	return c->eval->nwords - c->words;
+}
+
+static void
+patch(Compiler *c, Word chain)
+{
+	Word *word;
+
+	/* make each jump in the chain jump here */
+	while (chain != NOLABEL) {
+		word = &c->eval->words[c->words + chain];
+		chain = *word;
+		*word = label(c);
+	}
+}
+
+static void
+pushed(Compiler *c, SimpSiz n)
+{
+	c->depth += n;
+	if (c->depth > c->maxdepth) {
+		c->maxdepth = c->depth;
+	}
+}
+
+static void
+popped(Compiler *c, SimpSiz n)
+{
+	c->depth -= n;
+}
+
+static void
+fail(Compiler *c, Simp expr, Simp sym, Simp obj, Word message)
+{
+	emit(c, OP_ERROR);
+	emit(c, constant(c, expr));
+	emit(c, constant(c, sym));
+	emit(c, constant(c, obj));
+	emit(c, message);
+	pushed(c, 1);
+}
+
+static void
+compileconst(Compiler *c, Simp obj, bool tail)
+{
+	emit(c, OP_CONST);
+	emit(c, constant(c, obj));
+	pushed(c, 1);
+	if (tail) {
+		emit(c, OP_RETURN);
+	}
+}
+
 static Simp
-simp_eval(Eval *eval, Simp expr, Simp env)
+globalsyntax(Compiler *c, Simp sym)
 {
-	Builtin *bltin;
-	Simp sym, operator, operands, body, macro;
-	Simp args, param, varargs, var, val;
-	SimpSiz nargs, noperands, i;
-
-loop:
-	if (simp_issymbol(expr))   /* expression is variable */
-		return envget(eval, expr, env, expr);
-	if (!simp_isvector(expr))  /* expression is self-evaluating */
-		return expr;
-	if ((noperands = simp_getsize(expr)) == 0)
-		error(eval, expr, simp_void(), simp_void(), ERROR_EMPTY);
-	noperands--;
+	Simp env, frame;
+	SimpSiz i;
+
+	/*
+	 * A symbol which has only ever been bound in the global syntax
+	 * frame names the same macro wherever it is used, as long as
+	 * the syntax version is the same; a macro named so is compiled
+	 * inline.
+	 */
+	if (c->nomacros || simp_contextversion(c->eval->ctx) < 0 ||
+	    simp_islocalsyntax(sym))
+		return simp_void();
+	env = simp_contextenv(c->eval->ctx);
+	if (!simp_isenvironment(env))
+		return simp_void();
+	frame = simp_getenvsynframe(env);
+	if (!framefind(frame, sym, &i))
+		return simp_void();
+	return simp_getframevalue(frame, i);
+}
+
+static Builtin *
+globalmacro(Compiler *c, Simp sym)
+{
+	Simp macro;
+
+	macro = globalsyntax(c, sym);
+	if (!simp_isbuiltin(macro) || simp_getsize(simp_getbuiltinargs(macro)) > 0)
+		return NULL;
+	return simp_getbuiltin(macro);
+}
+
+static Compiler compiler(Eval *eval, bool nomacros);
+static Simp makecode(Compiler *c, Builtin *form);
+static void compileexpr(Compiler *c, Simp expr, bool tail);
+
+static bool
+isnative(Builtin *bltin)
+{
+	/* whether the builtin macro is compiled inline */
+	switch (bltin->type) {
+	case BLTIN_APPLY:
+	case BLTIN_EVAL:
+		return false;
+	case BLTIN_ROUTINE:
+		return bltin->macro == f_and || bltin->macro == f_or ||
+		       bltin->macro == f_define || bltin->macro == f_redefine ||
+		       bltin->macro == f_lambda || bltin->macro == f_quote ||
+		       bltin->macro == f_true || bltin->macro == f_false;
+	default:
+		return true;
+	}
+}
+
+static void
+compilelambda(Compiler *c, Simp expr, Simp args)
+{
+	Compiler body;
+	Simp code, box;
+	SimpSiz nargs;
+	Word k;
+
+	/*
+	 * The body is compiled once, into a box shared by every closure
+	 * made from the lambda expression.
+	 */
+	nargs = simp_getsize(args);
+	body = compiler(c->eval, c->nomacros);
+	body.inlining = c->inlining;
+	compileexpr(
+		&body,
+		nargs > 0 ? simp_getvectormemb(args, nargs - 1) : simp_void(),
+		true
+	);
+	code = makecode(&body, NULL);
+	if (!simp_makevector(c->eval->ctx, &box, 1))
+		memerror(c->eval);
+	simp_setvector(c->eval->ctx, box, 0, code);
+	k = constant(c, expr);
+	(void)constant(c, args);
+	(void)constant(c, box);
+	emit(c, OP_LAMBDA);
+	emit(c, k);
+	pushed(c, 1);
+}
+
+static void
+compilecall(Compiler *c, Simp expr, bool tail)
+{
+	Simp operator;
+	SimpSiz n, i;
+	Word e, skip;
+
+	/*
+	 * The operator is evaluated before the operands.  An operator
+	 * named by a symbol which was not a macro when compiled may have
+	 * become one when run; the call is then evaluated as a macro
+	 * call, and the operands are skipped.
+	 */
+	n = simp_getsize(expr) - 1;
 	operator = simp_getvectormemb(expr, 0);
-	sym = operator;
-	if (simp_issymbol(operator) && syntaxget(&macro, env, operator)) {
-		operator = macro;
-		operands = simp_slicevector(expr, 1, noperands);
-		if (simp_isbuiltin(operator)) {
-			bltin = simp_getbuiltin(operator);
-			goto dispatch;
-		}
-		if (!simp_isclosure(operator))
-			error(eval, expr, simp_void(), sym, ERROR_NOTPROC);
-		for (i = 0; i < noperands; i++) {
-			if (!simp_isclosure(operator))
-				error(eval, expr, sym, simp_void(), ERROR_ILLMACRO);
-			param = simp_getclosureparam(operator);
-			varargs = simp_getclosurevarargs(operator);
-			operator = simp_getclosurebody(operator);
-			if (simp_isfalse(param))
-				error(eval, expr, sym, simp_void(), ERROR_NARGS);
-			if (simp_isfalse(varargs)) {
-				val = simp_getvectormemb(operands, i);
-				envdef(eval, expr, env, param, val, false);
-			} else {
-				val = simp_slicevector(operands, i, noperands - i);
-				envdef(eval, expr, env, param, val, false);
-				break;
+	e = constant(c, expr);
+	skip = NOLABEL;
+	if (simp_issymbol(operator) && !c->nomacros) {
+		emit(c, OP_FUNC);
+		emit(c, constant(c, operator));
+		emit(c, c->nsites++);
+		emit(c, e);
+		skip = label(c);
+		emit(c, NOLABEL);
+		pushed(c, 1);
+	} else {
+		compileexpr(c, operator, false);
+	}
+	for (i = 1; i <= n; i++)
+		compileexpr(c, simp_getvectormemb(expr, i), false);
+	emit(c, tail ? OP_TAIL : OP_CALL);
+	emit(c, n);
+	emit(c, e);
+	popped(c, n);
+	patch(c, skip);
+	if (tail) {
+		emit(c, OP_RETURN);
+	}
+}
+
+static bool
+compileform(Compiler *c, Simp expr, Builtin *bltin, bool tail)
+{
+	Simp sym, var;
+	SimpSiz n, i;
+	Word e, chain, next;
+
+	/*
+	 * Compile a builtin macro inline, after checking its form; the
+	 * errors in the form are raised when the code is run.
+	 */
+	if (!isnative(bltin))
+		return false;
+	sym = simp_getvectormemb(expr, 0);
+	n = simp_getsize(expr) - 1;
+	if (bltin->variadic ? n < bltin->nargs : n != bltin->nargs) {
+		fail(c, expr, sym, simp_void(), MESSAGE_NARGS);
+		return true;
+	}
+	e = constant(c, expr);
+	switch (bltin->type) {
+	case BLTIN_DEFMACRO:
+	case BLTIN_DEFUN:
+		/* (defun NAME PARAMETER ... BODY) */
+		var = simp_getvectormemb(expr, 1);
+		if (!simp_issymbol(var)) {
+			fail(c, expr, sym, var, MESSAGE_NOTSYM);
+			return true;
+		}
+		compilelambda(c, expr, simp_slicevector(expr, 2, n - 1));
+		emit(c, bltin->type == BLTIN_DEFMACRO ? OP_DEFSYNTAX : OP_DEFINE);
+		emit(c, constant(c, var));
+		emit(c, e);
+		if (bltin->type == BLTIN_DEFUN)
+			c->ndefines++;
+		break;
+	case BLTIN_DO:
+		/* (do EXPRESSION ...) */
+		if (n == 0) {
+			compileconst(c, simp_void(), tail);
+			return true;
+		}
+		for (i = 1; i < n; i++) {
+			compileexpr(c, simp_getvectormemb(expr, i), false);
+			emit(c, OP_POP);
+			popped(c, 1);
+		}
+		compileexpr(c, simp_getvectormemb(expr, n), tail);
+		return true;
+	case BLTIN_IF:
+		/* (if [COND THEN]... [ELSE]) */
+		chain = NOLABEL;
+		for (i = 1; i < n; i += 2) {
+			compileexpr(c, simp_getvectormemb(expr, i), false);
+			emit(c, OP_JUMPF);
+			emit(c, e);
+			next = label(c);
+			emit(c, NOLABEL);
+			popped(c, 1);
+			compileexpr(c, simp_getvectormemb(expr, i + 1), tail);
+			popped(c, 1);
+			if (!tail) {
+				emit(c, OP_JUMP);
+				emit(c, chain);
+				chain = label(c) - 1;
 			}
+			patch(c, next);
+		}
+		if (i == n)
+			compileexpr(c, simp_getvectormemb(expr, n), tail);
+		else
+			compileconst(c, simp_void(), tail);
+		patch(c, chain);
+		return true;
+	case BLTIN_LET:
+		/* (let [VARIABLE VALUE]... BODY) */
+		if (n % 2 == 0) {
+			fail(c, expr, sym, simp_void(), MESSAGE_ILLMACRO);
+			return true;
 		}
-		if (simp_isclosure(operator))
-			error(eval, expr, sym, simp_void(), ERROR_ILLMACRO);
-		expr = operator;
-		goto loop;
+		for (i = 1; i < n; i += 2) {
+			var = simp_getvectormemb(expr, i);
+			if (!simp_issymbol(var)) {
+				fail(c, expr, sym, var, MESSAGE_NOTSYM);
+				return true;
+			}
+		}
+		emit(c, OP_ENTER);
+		pushed(c, 1);
+		for (i = 1; i < n; i += 2) {
+			compileexpr(c, simp_getvectormemb(expr, i + 1), false);
+			emit(c, OP_BIND);
+			emit(c, constant(c, simp_getvectormemb(expr, i)));
+			emit(c, e);
+			popped(c, 1);
+		}
+		compileexpr(c, simp_getvectormemb(expr, n), tail);
+		if (tail)
+			return true;
+		emit(c, OP_LEAVE);
+		popped(c, 1);
+		return true;
+	case BLTIN_ROUTINE:
+		if (bltin->macro == f_quote) {
+			compileconst(c, simp_getvectormemb(expr, 1), tail);
+			return true;
+		}
+		if (bltin->macro == f_true || bltin->macro == f_false) {
+			compileconst(c, bltin->macro == f_true ? simp_true() : simp_false(), tail);
+			return true;
+		}
+		if (bltin->macro == f_lambda) {
+			compilelambda(c, expr, simp_slicevector(expr, 1, n));
+			break;
+		}
+		if (bltin->macro == f_define || bltin->macro == f_redefine) {
+			var = simp_getvectormemb(expr, 1);
+			if (!simp_issymbol(var)) {
+				fail(c, expr, sym, var, MESSAGE_NOTSYM);
+				return true;
+			}
+			compileexpr(c, simp_getvectormemb(expr, 2), false);
+			emit(c, bltin->macro == f_define ? OP_DEFINE : OP_REDEFINE);
+			emit(c, constant(c, var));
+			emit(c, e);
+			if (bltin->macro == f_define)
+				c->ndefines++;
+			break;
+		}
+
+		/* (and EXPRESSION ...), (or EXPRESSION ...) */
+		if (n == 0) {
+			compileconst(c, simp_true(), tail);
+			return true;
+		}
+		chain = NOLABEL;
+		for (i = 1; i < n; i++) {
+			compileexpr(c, simp_getvectormemb(expr, i), false);
+			emit(c, bltin->macro == f_and ? OP_AND : OP_OR);
+			emit(c, e);
+			emit(c, chain);
+			chain = label(c) - 1;
+			popped(c, 1);
+		}
+		compileexpr(c, simp_getvectormemb(expr, n), false);
+		emit(c, OP_VALUE);
+		emit(c, e);
+		patch(c, chain);
+		break;
+	default:
+		return false;
 	}
+	if (tail) {
+		emit(c, OP_RETURN);
+	}
+	return true;
+}
 
-	/* evaluate operands */
-	operands = expr;
-	if (!simp_makevector(eval->ctx, &operands, noperands))
-		memerror(eval);
-	for (i = 0; i < noperands; i++) {
-		val = simp_getvectormemb(expr, i + 1);
-		val = simp_eval(eval, val, env);
-		if (simp_isvoid(val))
-			error(eval, expr, sym, simp_void(), ERROR_VOID);
-		simp_setvector(operands, i, val);
+static bool
+compilemacro(Compiler *c, Simp expr, bool tail)
+{
+	Simp macro, params, val;
+	SimpSiz n, nparams, i;
+	Word e, fallback, end;
+	bool variadic;
+
+	/*
+	 * Expand a call of a macro closure inline, as expand() does when
+	 * run: bind its parameters to the operands, and evaluate its body,
+	 * in the environment of the call.  If a macro has been defined
+	 * since the code was compiled, the call is expanded when run
+	 * instead.  Macro calls in a body expanded inline (or in the
+	 * lambda expressions in it) are not expanded inline themselves,
+	 * so a recursive macro is not expanded forever.
+	 */
+	if (c->inlining)
+		return false;
+	macro = globalsyntax(c, simp_getvectormemb(expr, 0));
+	if (!simp_isclosure(macro))
+		return false;
+	n = simp_getsize(expr) - 1;
+	params = simp_getclosureparams(macro);
+	nparams = simp_getsize(params);
+	variadic = simp_istrue(simp_getclosurevarargs(macro));
+	if (variadic ? n < nparams : n != nparams)
+		return false;
+	e = constant(c, expr);
+	emit(c, OP_SYNTAX);
+	fallback = label(c);
+	emit(c, NOLABEL);
+	for (i = 0; i < nparams; i++) {
+		if (variadic && i + 1 == nparams)
+			val = simp_slicevector(expr, i + 1, n - i);
+		else
+			val = simp_getvectormemb(expr, i + 1);
+		compileconst(c, val, false);
+		emit(c, OP_DEFINE);
+		emit(c, constant(c, simp_getvectormemb(params, i)));
+		emit(c, e);
+		emit(c, OP_POP);
+		popped(c, 1);
+		c->ndefines++;
+	}
+	c->inlining = true;
+	compileexpr(c, simp_getclosurebody(macro), tail);
+	c->inlining = false;
+	popped(c, 1);
+	end = NOLABEL;
+	if (!tail) {
+		emit(c, OP_JUMP);
+		end = label(c);
+		emit(c, NOLABEL);
+	}
+	patch(c, fallback);
+	emit(c, tail ? OP_TAILMACRO : OP_MACRO);
+	emit(c, e);
+	emit(c, c->nsites++);
+	emit(c, constant(c, simp_false()));
+	pushed(c, 1);
+	patch(c, end);
+	return true;
+}
+
+static void
+compileexpr(Compiler *c, Simp expr, bool tail)
+{
+	Builtin *bltin;
+	Simp operator;
+
+	/* code in tail position returns, rather than falling through */
+	if (simp_issymbol(expr)) {
+		emit(c, OP_VAR);
+		emit(c, constant(c, expr));
+		emit(c, c->nsites++);
+		pushed(c, 1);
+	} else if (!simp_isvector(expr)) {
+		compileconst(c, expr, tail);
+		return;
+	} else if (simp_getsize(expr) == 0) {
+		fail(c, expr, simp_void(), simp_void(), MESSAGE_EMPTY);
+		return;
+	} else if (operator = simp_getvectormemb(expr, 0),
+	           c->nomacros || !simp_issymbol(operator) ||
+	           !simp_issyntax(operator)) {
+		compilecall(c, expr, tail);
+		return;
+	} else if ((bltin = globalmacro(c, operator)) != NULL &&
+	           compileform(c, expr, bltin, tail)) {
+		return;
+	} else if (compilemacro(c, expr, tail)) {
+		return;
+	} else {
+		emit(c, tail ? OP_TAILMACRO : OP_MACRO);
+		emit(c, constant(c, expr));
+		emit(c, c->nsites++);
+		emit(c, constant(c, simp_false()));
+		pushed(c, 1);
+		if (tail) {
+			return;
+		}
 	}
+	if (tail) {
+		emit(c, OP_RETURN);
+	}
+}
 
-	/* evaluate operator */
-	operator = simp_eval(eval, operator, env);
-	if (simp_isclosure(operator)) {
-		env = simp_getclosureenv(operator);
-		if (!simp_makeenvironment(eval->ctx, &env, env)) {
+static Compiler
+compiler(Eval *eval, bool nomacros)
+{
+	return (Compiler){
+		.eval = eval,
+		.words = eval->nwords,
+		.consts = eval->nconsts,
+		.nomacros = nomacros,
+	};
+}
+
+static Simp
+makecode(Compiler *c, Builtin *form)
+{
+	Eval *eval;
+	Code *header;
+	Simp code, words, consts;
+	SimpSiz nwords, nconsts, i;
+
+	/*
+	 * The words and constants are kept in buffers shared by nested
+	 * compilations (of the body of lambda expressions) until the
+	 * code is made out of them.
+	 */
+	eval = c->eval;
+	nwords = eval->nwords - c->words;
+	nconsts = eval->nconsts - c->consts;
+	if (!simp_makestring(
+		eval->ctx, &words, NULL,
+		sizeof(Code) + c->nsites * sizeof(Site) + nwords * sizeof(Word)
+	)) memerror(eval);
+	if (!simp_makevector(eval->ctx, &consts, nconsts))
+		memerror(eval);
+	if (!simp_makevector(eval->ctx, &code, CODE_SIZE))
+		memerror(eval);
+	header = (Code *)simp_getstring(words);
+	*header = (Code){
+		.version = simp_contextsynversion(eval->ctx),
+		.form = form,
+		.maxstack = c->maxdepth,
+		.ndefines = c->ndefines,
+		.nsites = c->nsites,
+		.nwords = nwords,
+	};
+	memset(getsites(header), 0, c->nsites * sizeof(Site));
+	memcpy(getwords(header), &eval->words[c->words], nwords * sizeof(Word));
+	for (i = 0; i < nconsts; i++)
+		simp_setvector(eval->ctx, consts, i, eval->consts[c->consts + i]);
+	simp_setvector(eval->ctx, code, CODE_WORDS, words);
+	simp_setvector(eval->ctx, code, CODE_CONSTANTS, consts);
+	eval->nwords = c->words;
+	eval->nconsts = c->consts;
+	return code;
+}
+
+static Simp
+compile(Eval *eval, Simp expr, bool nomacros)
+{
+	Compiler c;
+
+	/* compile an expression into code returning its value */
+	c = compiler(eval, nomacros);
+	compileexpr(&c, expr, true);
+	return makecode(&c, NULL);
+}
+
+static bool
+iscurrent(Eval *eval, Simp code, Builtin *form)
+{
+	/* code compiled for another syntax version must be compiled again */
+	return simp_isvector(code) &&
+	       getcode(code)->version == simp_contextsynversion(eval->ctx) &&
+	       getcode(code)->form == form;
+}
+
+static Simp
+formcode(Eval *eval, Simp expr, Builtin *form, Simp cache, SimpSiz k)
+{
+	Compiler c;
+	Simp code;
+
+	/*
+	 * Compile a call of a builtin macro which was not compiled inline
+	 * (or a call whose operator was a macro when compiled, but is not
+	 * a macro where it is run, if the form is NULL).  The code is
+	 * cached in the constant k of the code the call was compiled in,
+	 * if any, and the call is analysed only once.
+	 */
+	if (!simp_isnil(cache)) {
+		code = simp_getvectormemb(cache, k);
+		if (iscurrent(eval, code, form))
+			return code;
+	}
+	c = compiler(eval, false);
+	if (form != NULL)
+		(void)compileform(&c, expr, form, true);
+	else
+		compilecall(&c, expr, true);
+	code = makecode(&c, form);
+	if (!simp_isnil(cache))
+		simp_setvector(eval->ctx, cache, k, code);
+	return code;
+}
+
+static Simp
+closurecode(Eval *eval, Simp closure)
+{
+	Simp box, code;
+
+	/*
+	 * The closures made from the same lambda expression share a box
+	 * with the code of their body, which is thus analysed only once
+	 * for all of them.
+	 */
+	box = simp_getclosurecode(closure);
+	if (!simp_isvector(box)) {
+		if (!simp_makevector(eval->ctx, &box, 1))
 			memerror(eval);
+		simp_setvector(eval->ctx, box, 0, simp_false());
+		simp_setclosurecode(eval->ctx, closure, box);
+	}
+	code = simp_getvectormemb(box, 0);
+	if (iscurrent(eval, code, NULL))
+		return code;
+	code = compile(eval, simp_getclosurebody(closure), false);
+	simp_setvector(eval->ctx, box, 0, code);
+	return code;
+}
+
+static void
+checkargs(Eval *eval, Simp expr, SimpSiz n)
+{
+	SimpSiz i;
+
+	/* the operator and the operands are on the top of the stack */
+	for (i = 0; i <= n; i++) {
+		if (simp_isvoid(eval->stack[eval->sp - i - 1])) {
+			error(
+				eval, expr,
+				simp_getvectormemb(expr, 0),
+				simp_void(), ERROR_VOID
+			);
 		}
 	}
+}
 
-apply:
-	if (simp_isvoid(operator))
-		error(eval, expr, sym, simp_void(), ERROR_VOID);
-	if (simp_isclosure(operator)) {
-		body = simp_getclosurebody(operator);
-		param = simp_getclosureparam(operator);
-		varargs = simp_getclosurevarargs(operator);
-		if (simp_isfalse(param)) {
-			/* nullary closure */
-			if (noperands == 0) {
-				expr = body;
-				goto loop;
-			}
+static bool
+bindargs(Eval *eval, Simp closure, SimpSiz n, Simp *env, Simp *code)
+{
+	Simp params;
+	SimpSiz nparams;
+	bool variadic;
+
+	/*
+	 * Bind the n values on the top of the stack to the parameters of
+	 * a closure, in a new environment, if they are just enough for
+	 * its body to be evaluated; and get the code of its body, whose
+	 * definitions are given room in the frame.
+	 */
+	params = simp_getclosureparams(closure);
+	nparams = simp_getsize(params);
+	variadic = simp_istrue(simp_getclosurevarargs(closure));
+	if (nparams == 0 ? n > 0 : n == 0 || n < nparams || (!variadic && n > nparams))
+		return false;
+	*code = closurecode(eval, closure);
+	if (!simp_makeenvironment(eval->ctx, env, simp_getclosureenv(closure)))
+		memerror(eval);
+	if (!simp_envbind(
+		eval->ctx, *env, params,
+		&eval->stack[eval->sp - n], n, variadic,
+		getcode(*code)->ndefines
+	)) memerror(eval);
+	return true;
+}
+
+static bool
+rebindargs(Eval *eval, Simp closure, SimpSiz n, Simp env, Simp *code)
+{
+	Simp params;
+
+	/*
+	 * Bind the n values on the top of the stack to the parameters of
+	 * a closure in place, in the frame of an environment which cannot
+	 * be reached anymore, if it was made for the same parameters and
+	 * under the same parent (as when a closure calls itself in tail
+	 * position).
+	 */
+	params = simp_getclosureparams(closure);
+	if (n == 0 || simp_istrue(simp_getclosurevarargs(closure)) ||
+	    !simp_issame(simp_getenvparent(env), simp_getclosureenv(closure)) ||
+	    !simp_envrebind(eval->ctx, env, params, &eval->stack[eval->sp - n], n))
+		return false;
+	*code = closurecode(eval, closure);
+	return true;
+}
+
+static Simp run(Eval *eval, Simp code, Simp env);
+
+static bool
+expand(Eval *eval, Simp expr, Simp env, Simp macro, Simp cache, SimpSiz k, Simp *ret)
+{
+	Builtin *bltin;
+	Simp sym, operands, params, varargs, val;
+	SimpSiz noperands, nparams, i, nroots;
+
+	/*
+	 * Evaluate a macro call, either into the code evaluating it in
+	 * the environment of the call (returning true), or into its value
+	 * (returning false).  The operands of a macro are bound, not
+	 * evaluated, in the environment of the call.  A void macro stands
+	 * for an operator which is not a macro here.
+	 */
+	if (simp_isvoid(macro)) {
+		*ret = formcode(eval, expr, NULL, cache, k);
+		return true;
+	}
+	sym = simp_getvectormemb(expr, 0);
+	noperands = simp_getsize(expr) - 1;
+	operands = simp_slicevector(expr, 1, noperands);
+	if (simp_isbuiltin(macro)) {
+		bltin = simp_getbuiltin(macro);
+		if (isnative(bltin)) {
+			*ret = formcode(eval, expr, bltin, cache, k);
+			return true;
+		}
+		if (bltin->variadic ? noperands < bltin->nargs : noperands != bltin->nargs)
 			error(eval, expr, sym, simp_void(), ERROR_NARGS);
+		nroots = simp_gcgetroots(eval->ctx);
+		*ret = simp_void();
+		gcprotect(eval, ret);
+		(*bltin->macro)(eval, ret, bltin->self, expr, env, operands);
+		simp_gcsetroots(eval->ctx, nroots);
+		return false;
+	}
+	if (!simp_isclosure(macro))
+		error(eval, expr, simp_void(), sym, ERROR_NOTPROC);
+	params = simp_getclosureparams(macro);
+	nparams = simp_getsize(params);
+	varargs = simp_getclosurevarargs(macro);
+	if (simp_isfalse(varargs) ? noperands != nparams : noperands < nparams)
+		error(eval, expr, sym, simp_void(), ERROR_NARGS);
+	for (i = 0; i < nparams; i++) {
+		if (simp_istrue(varargs) && i + 1 == nparams)
+			val = simp_slicevector(operands, i, noperands - i);
+		else
+			val = simp_getvectormemb(operands, i);
+		envdef(eval, expr, env, simp_getvectormemb(params, i), val, false);
+	}
+	*ret = closurecode(eval, macro);
+	return true;
+}
+
+static Simp
+macrocall(Eval *eval, Simp expr, Simp env, Simp macro)
+{
+	Simp val;
+
+	if (expand(eval, expr, env, macro, simp_nil(), 0, &val))
+		val = run(eval, val, env);
+	return val;
+}
+
+#if THREADED
+static void
+thread(Code *header, void *const *handlers)
+{
+	static const SimpSiz noperands[] = {
+#define X(op, n) [op] = n,
+		OPCODES
+#undef  X
+	};
+	Word *words, op;
+	SimpSiz i;
+
+	/* replace each opcode by the address of its handler */
+	words = getwords(header);
+	for (i = 0; i < header->nwords; i += 1 + noperands[op]) {
+		op = words[i];
+		words[i] = (Word)handlers[op];
+	}
+}
+#endif
+
+static Simp
+run(Eval *eval, Simp code, Simp env)
+{
+#if THREADED
+	static void *const handlers[] = {
+#define X(op, n) [op] = LABEL(op),
+		OPCODES
+#undef  X
+	};
+#endif
+	Code *header;
+	Site *sites;
+	Word *words, *pc;
+	Simp *consts;
+	Simp expr, sym, val, macro, fresh;
+	SimpSiz base, n, ncaptures;
+	bool tail;
+
+	/*
+	 * Run code in an environment, on the stack above the values
+	 * already there.  The code and the environment are kept on the
+	 * stack, under the values pushed by the code; a call in tail
+	 * position reuses them for the code of the procedure it calls.
+	 *
+	 * The environment made by a call in tail position is fresh: it
+	 * can only be reached from here until a closure is made or a
+	 * macro is expanded here, or an environment is made a value
+	 * anywhere.  The next call in tail position rebinds its frame
+	 * in place while it is fresh, rather than making a new one.
+	 */
+	base = eval->sp;
+	reserve(eval, FRAME_SIZE);
+	fresh = simp_void();
+	ncaptures = 0;
+enter:
+	eval->stack[base + FRAME_CODE] = code;
+	eval->stack[base + FRAME_ENVIRONMENT] = env;
+	eval->sp = base + FRAME_SIZE;
+	gcpoint(eval);
+	header = getcode(code);
+#if THREADED
+	if (!header->threaded) {
+		thread(header, handlers);
+		header->threaded = true;
+	}
+#endif
+	reserve(eval, header->maxstack);
+	sites = getsites(header);
+	words = pc = getwords(header);
+	consts = simp_getvector(simp_getvectormemb(code, CODE_CONSTANTS));
+	DISPATCH(*pc++) {
+	HANDLER(OP_CONST)
+		eval->stack[eval->sp++] = consts[pc[0]];
+		pc += 1;
+		NEXT;
+	HANDLER(OP_VAR)
+		eval->stats->nevals++;
+		sym = consts[pc[0]];
+		val = envget(eval, sym, env, sym, &sites[pc[1]]);
+		eval->stack[eval->sp++] = val;
+		pc += 2;
+		NEXT;
+	HANDLER(OP_FUNC)
+		eval->stats->nevals++;
+		sym = consts[pc[0]];
+		if (simp_issyntax(sym) &&
+		    syntaxget(eval, &macro, env, sym, &sites[pc[1]])) {
+			fresh = simp_void();
+			val = macrocall(eval, consts[pc[2]], env, macro);
+			eval->stack[eval->sp++] = val;
+			pc = words + pc[3];
+			NEXT;
 		}
-		if (noperands == 0) {
-			/* unary closure with no argument */
-			return operator;
+		val = envget(eval, sym, env, sym, &sites[pc[1]]);
+		eval->stack[eval->sp++] = val;
+		pc += 4;
+		NEXT;
+	HANDLER(OP_CALL)
+		eval->stats->nevals++;
+		val = apply(eval, consts[pc[1]], env, pc[0]);
+		eval->stack[eval->sp++] = val;
+		pc += 2;
+		NEXT;
+	HANDLER(OP_TAIL)
+		eval->stats->nevals++;
+		n = pc[0];
+		expr = consts[pc[1]];
+		val = eval->stack[eval->sp - n - 1];
+		if (simp_isclosure(val)) {
+			checkargs(eval, expr, n);
+			if (simp_issame(env, fresh) &&
+			    ncaptures == eval->ncaptures &&
+			    rebindargs(eval, val, n, env, &code))
+				goto enter;
+			if (bindargs(eval, val, n, &env, &code)) {
+				fresh = env;
+				ncaptures = eval->ncaptures;
+				goto enter;
+			}
 		}
-		if (simp_isfalse(varargs)) {
-			val = simp_getvectormemb(operands, 0);
-			operands = simp_slicevector(operands, 1, noperands - 1);
-			noperands--;
-		} else {
-			val = operands;
-			operands = simp_nil();
-			noperands = 0;
-		}
-		envdef(eval, expr, env, param, val, false);
-		if (noperands > 0) {
-			operator = simp_eval(eval, body, env);
-			goto apply;
+		val = apply(eval, expr, env, n);
+		goto done;
+	HANDLER(OP_SYNTAX)
+		if (header->version != simp_contextsynversion(eval->ctx))
+			pc = words + pc[0];
+		else
+			pc += 1;
+		NEXT;
+	HANDLER(OP_MACRO)
+		tail = false;
+		goto macro;
+	HANDLER(OP_TAILMACRO)
+		tail = true;
+macro:
+		eval->stats->nevals++;
+		fresh = simp_void();
+		expr = consts[pc[0]];
+		sym = simp_getvectormemb(expr, 0);
+		if (!syntaxget(eval, &macro, env, sym, &sites[pc[1]]))
+			macro = simp_void();
+		if (!expand(eval, expr, env, macro,
+		            simp_getvectormemb(code, CODE_CONSTANTS), pc[2], &val)) {
+			/* the macro call evaluated into its value */
+		} else if (tail) {
+			code = val;
+			goto enter;
 		} else {
-			expr = body;
-			goto loop;
+			val = run(eval, val, env);
+		}
+		if (tail)
+			goto done;
+		eval->stack[eval->sp++] = val;
+		pc += 3;
+		NEXT;
+	HANDLER(OP_JUMP)
+		pc = words + pc[0];
+		NEXT;
+	HANDLER(OP_JUMPF)
+		val = eval->stack[--eval->sp];
+		if (simp_isvoid(val))
+			goto isvoid;
+		pc = simp_isfalse(val) ? words + pc[1] : pc + 2;
+		NEXT;
+	HANDLER(OP_AND)
+		val = eval->stack[eval->sp - 1];
+		if (simp_isvoid(val))
+			goto isvoid;
+		if (simp_isfalse(val)) {
+			pc = words + pc[1];
+			NEXT;
+		}
+		eval->sp--;
+		pc += 2;
+		NEXT;
+	HANDLER(OP_OR)
+		val = eval->stack[eval->sp - 1];
+		if (simp_isvoid(val))
+			goto isvoid;
+		if (simp_istrue(val)) {
+			pc = words + pc[1];
+			NEXT;
 		}
+		eval->sp--;
+		pc += 2;
+		NEXT;
+	HANDLER(OP_VALUE)
+		if (simp_isvoid(eval->stack[eval->sp - 1]))
+			goto isvoid;
+		pc += 1;
+		NEXT;
+	HANDLER(OP_POP)
+		eval->sp--;
+		NEXT;
+	HANDLER(OP_RETURN)
+		val = eval->stack[--eval->sp];
+		goto done;
+	HANDLER(OP_LAMBDA)
+		fresh = simp_void();
+		expr = consts[pc[0]];
+		f_lambda(
+			eval, &val,
+			simp_getvectormemb(expr, 0), expr,
+			env, consts[pc[0] + 1]
+		);
+		simp_setclosurecode(eval->ctx, val, consts[pc[0] + 2]);
+		eval->stack[eval->sp++] = val;
+		pc += 1;
+		NEXT;
+	HANDLER(OP_DEFINE)
+		envdef(
+			eval, consts[pc[1]], env, consts[pc[0]],
+			eval->stack[eval->sp - 1], false
+		);
+		eval->stack[eval->sp - 1] = simp_void();
+		pc += 2;
+		NEXT;
+	HANDLER(OP_DEFSYNTAX)
+		envdef(
+			eval, consts[pc[1]], env, consts[pc[0]],
+			eval->stack[eval->sp - 1], true
+		);
+		eval->stack[eval->sp - 1] = simp_void();
+		pc += 2;
+		NEXT;
+	HANDLER(OP_REDEFINE)
+		envset(
+			eval, consts[pc[1]], env, consts[pc[0]],
+			eval->stack[eval->sp - 1], false
+		);
+		eval->stack[eval->sp - 1] = simp_void();
+		pc += 2;
+		NEXT;
+	HANDLER(OP_ENTER)
+		eval->stack[eval->sp++] = env;
+		if (!simp_makeenvironment(eval->ctx, &env, env))
+			memerror(eval);
+		eval->stack[base + FRAME_ENVIRONMENT] = env;
+		NEXT;
+	HANDLER(OP_BIND)
+		val = eval->stack[--eval->sp];
+		envdef(eval, consts[pc[1]], env, consts[pc[0]], val, false);
+		pc += 2;
+		NEXT;
+	HANDLER(OP_LEAVE)
+		val = eval->stack[--eval->sp];
+		env = eval->stack[eval->sp - 1];
+		eval->stack[eval->sp - 1] = val;
+		eval->stack[base + FRAME_ENVIRONMENT] = env;
+		NEXT;
+	HANDLER(OP_ERROR)
+		error(
+			eval, consts[pc[0]], consts[pc[1]],
+			consts[pc[2]], messages[pc[3]]
+		);
+		abort();
+#if !THREADED
+	default:
+		/* UNREACHABLE */
+		abort();
+#endif
+	}
+isvoid:
+	expr = consts[pc[0]];
+	error(eval, expr, simp_getvectormemb(expr, 0), simp_void(), ERROR_VOID);
+	abort();
+done:
+	eval->sp = base;
+	return val;
+}
+
+static Simp
+apply(Eval *eval, Simp expr, Simp env, SimpSiz n)
+{
+	Builtin *bltin;
+	Simp operator, args, params, code, val;
+	SimpSiz base, nargs, nparams, i, nroots;
+
+	/*
+	 * Apply the operator under the n values on the top of the stack
+	 * to them, and pop them all.
+	 */
+	base = eval->sp - n - 1;
+	gcpoint(eval);
+again:
+	checkargs(eval, expr, n);
+	operator = eval->stack[base];
+	if (simp_isclosure(operator)) {
+		if (bindargs(eval, operator, n, &env, &code)) {
+			val = run(eval, code, env);
+			goto done;
+		}
+		params = simp_getclosureparams(operator);
+		nparams = simp_getsize(params);
+		if (nparams == 0)
+			error(eval, expr, simp_getvectormemb(expr, 0), simp_void(), ERROR_NARGS);
+		if (n == 0) {
+			/* closure with no argument */
+			val = operator;
+			goto done;
+		}
+		if (!simp_makeenvironment(eval->ctx, &env, simp_getclosureenv(operator)))
+			memerror(eval);
+		if (n < nparams) {
+			/*
+			 * Partial application: the given arguments are bound,
+			 * and a closure over them takes the other ones.
+			 */
+			if (!simp_envbind(eval->ctx, env,
+			                  simp_slicevector(params, 0, n),
+			                  &eval->stack[base + 1], n, false, 0))
+				memerror(eval);
+			if (!simp_makeclosure(
+				eval->ctx,
+				&val, operator, env,
+				simp_slicevector(params, n, nparams - n),
+				simp_getclosurevarargs(operator),
+				simp_getclosurebody(operator)
+			)) memerror(eval);
+			simp_setclosurecode(eval->ctx, val, simp_getclosurecode(operator));
+			goto done;
+		}
+
+		/* the result of the body is applied to the remaining arguments */
+		code = closurecode(eval, operator);
+		if (!simp_envbind(
+			eval->ctx, env, params, &eval->stack[base + 1],
+			nparams, false, getcode(code)->ndefines
+		)) memerror(eval);
+		val = run(eval, code, env);
+		n -= nparams;
+		memmove(
+			&eval->stack[base + 1],
+			&eval->stack[base + 1 + nparams],
+			n * sizeof(*eval->stack)
+		);
+		eval->stack[base] = val;
+		eval->sp = base + 1 + n;
+		goto again;
 	}
 	if (!simp_isbuiltin(operator))
 		error(eval, expr, simp_void(), operator, ERROR_NOTPROC);
 	bltin = simp_getbuiltin(operator);
 	args = simp_getbuiltinargs(operator);
-	nargs = simp_getsize(args);
-	if (nargs > 0 && noperands > 0) {
-		if (!simp_makevector(eval->ctx, &val, nargs + noperands))
-			memerror(eval);
-		simp_cpyvector(val, args);
-		simp_cpyvector(simp_slicevector(val, nargs, noperands), operands);
-		operands = val;
-		noperands += nargs;
-	} if (noperands == 0) {
-		operands = args;
-		noperands = nargs;
-	}
-	if (noperands < bltin->nargs) {
+	if ((nargs = simp_getsize(args)) > 0) {
+		/* the arguments the builtin was applied to come first */
+		reserve(eval, nargs);
+		memmove(
+			&eval->stack[base + 1 + nargs],
+			&eval->stack[base + 1],
+			n * sizeof(*eval->stack)
+		);
+		for (i = 0; i < nargs; i++)
+			eval->stack[base + 1 + i] = simp_getvectormemb(args, i);
+		eval->sp += nargs;
+		n += nargs;
+	}
+	if (n < bltin->nargs) {
 		/* partially applied builtin */
-		if (!simp_makebuiltin(eval->ctx, &val, operands, bltin))
+		if (!simp_makevector(eval->ctx, &args, n))
+			memerror(eval);
+		for (i = 0; i < n; i++)
+			simp_setvector(eval->ctx, args, i, eval->stack[base + 1 + i]);
+		if (!simp_makebuiltin(eval->ctx, &val, args, bltin))
 			memerror(eval);
-		return val;
+		goto done;
 	}
-
-dispatch:
-	if (bltin->variadic && noperands < bltin->nargs)
-		error(eval, expr, sym, simp_void(), ERROR_NARGS);
-	if (!bltin->variadic && noperands != bltin->nargs)
-		error(eval, expr, sym, simp_void(), ERROR_NARGS);
+	if (!bltin->variadic && n != bltin->nargs)
+		error(eval, expr, simp_getvectormemb(expr, 0), simp_void(), ERROR_NARGS);
 	switch (bltin->type) {
 	case BLTIN_APPLY:
-		/* (apply PROCEDURE SYMBOL ... VECTOR) */
-		operator = simp_getvectormemb(operands, 0);
-		args = simp_getvectormemb(operands, noperands - 1);
+		/* (apply PROCEDURE ARGUMENT ... VECTOR) */
+		args = eval->stack[base + n];
 		if (!simp_isvector(args))
-			error(eval, expr, sym, args, ERROR_NOTVECTOR);
+			error(eval, expr, simp_getvectormemb(expr, 0), args, ERROR_NOTVECTOR);
+		memmove(
+			&eval->stack[base],
+			&eval->stack[base + 1],
+			(n - 1) * sizeof(*eval->stack)
+		);
+		n -= 2;
+		eval->sp = base + 1 + n;
 		nargs = simp_getsize(args);
-		noperands -= 2;
-		operands = simp_slicevector(operands, 1, noperands);
-		if (!simp_makevector(eval->ctx, &val, nargs + noperands))
-			memerror(eval);
-		simp_cpyvector(val, operands);
-		simp_cpyvector(simp_slicevector(val, noperands, nargs), args);
-		operands = val;
-		noperands += nargs;
-		goto apply;
-	case BLTIN_DEFMACRO:
-	case BLTIN_DEFUN:
-		if (!simp_makesymbol(eval->ctx, &sym, bltin->name, bltin->namelen))
-			memerror(eval);
-		var = simp_getvectormemb(operands, 0);
-		operands = simp_slicevector(operands, 1, noperands - 1);
-		f_lambda(eval, &val, sym, expr, env, operands);
-		envdef(eval, expr, env, var, val, bltin->type == BLTIN_DEFMACRO);
-		return simp_void();
-	case BLTIN_DO:
-		/* (do EXPRESSION ...) */
-		if (noperands == 0)
-			return simp_void();
-		for (i = 0; i + 1 < noperands; i++) {
-			val = simp_getvectormemb(operands, i);
-			val = simp_eval(eval, val, env);
-		}
-		expr = simp_getvectormemb(operands, i);
-		goto loop;
+		reserve(eval, nargs);
+		for (i = 0; i < nargs; i++)
+			eval->stack[eval->sp++] = simp_getvectormemb(args, i);
+		n += nargs;
+		goto again;
 	case BLTIN_EVAL:
 		/* (eval EXPRESSION ENVIRONMENT) */
-		expr = simp_getvectormemb(operands, 0);
-		env = simp_getvectormemb(operands, 1);
-		goto loop;
-	case BLTIN_IF:
-		/* (if [COND THEN]... [ELSE]) */
-		if (noperands < 2)
-			error(eval, expr, sym, simp_void(), ERROR_ILLMACRO);
-		for (i = 0; i + 1 < noperands; i++) {
-			val = simp_getvectormemb(operands, i);
-			val = simp_eval(eval, val, env);
-			if (simp_isvoid(val))
-				error(eval, expr, sym, simp_void(), ERROR_VOID);
-			i++;
-			if (simp_istrue(val)) {
-				break;
-			}
-		}
-		if (i < noperands) {
-			expr = simp_getvectormemb(operands, i);
-			goto loop;
-		}
-		return simp_void();
-	case BLTIN_LET:
-		if (noperands % 2 == 0)
-			error(eval, expr, sym, simp_void(), ERROR_ILLMACRO);
-		if (!simp_makeenvironment(eval->ctx, &env, env))
-			memerror(eval);
-		for (i = 0; i + 1 < noperands; i += 2) {
-			var = simp_getvectormemb(operands, i);
-			if (!simp_issymbol(var))
-				error(eval, expr, sym, var, ERROR_NOTSYM);
-			val = simp_getvectormemb(operands, i + 1);
-			val = simp_eval(eval, val, env);
-			envdef(eval, expr, env, var, val, false);
-		}
-		expr = simp_getvectormemb(operands, noperands - 1);
-		goto loop;
+		val = eval->stack[base + 2];
+		if (!simp_isenvironment(val))
+			error(eval, expr, simp_getvectormemb(expr, 0), val, ERROR_NOTENV);
+		val = simp_eval(eval, eval->stack[base + 1], val);
+		goto done;
 	case BLTIN_ROUTINE:
+		if (bltin->fix != NULL &&
+		    (*bltin->fix)(eval, &val, &eval->stack[base + 1], n))
+			goto done;
+		nroots = simp_gcgetroots(eval->ctx);
 		val = simp_void();
-		if (!simp_makesymbol(eval->ctx, &var, bltin->name, bltin->namelen))
-			memerror(eval);
-		(*bltin->fun)(eval, &val, var, expr, env, operands);
-		return val;
+		gcprotect(eval, &val);
+		(*bltin->fun)(
+			eval, &val, bltin->self, expr, env,
+			&eval->stack[base + 1], n
+		);
+		simp_gcsetroots(eval->ctx, nroots);
+		goto done;
+	default:
+		error(eval, expr, simp_void(), operator, ERROR_NOTPROC);
 	}
 	/* UNREACHABLE */
 	abort();
+done:
+	eval->sp = base;
+	return val;
+}
+
+static Simp
+simp_eval(Eval *eval, Simp expr, Simp env)
+{
+	/*
+	 * A compound expression is compiled, and its code is run; the
+	 * code of the body of a closure is kept with the closure.
+	 */
+	eval->stats->nevals++;
+	if (simp_issymbol(expr))
+		return envget(eval, expr, env, expr, NULL);
+	if (!simp_isvector(expr))
+		return expr;
+	return run(eval, compile(eval, expr, simp_isnulenv(env)), env);
 }
 
 bool
@@ -2259,16 +3775,33 @@ simp_repl(Simp ctx, Simp env, Simp rport, Simp iport, Simp oport, Simp eport, in
 		.iport = iport,
 		.oport = oport,
 		.eport = eport,
+		.stats = simp_gcstats(ctx),
 	};
+	SimpSiz nroots, i;
 	bool retval = false;
 
+	nroots = simp_gcgetroots(ctx);
+	for (i = 0; i < LEN(gcignore); i++)
+		if (!simp_gcprotect(ctx, &gcignore[i]))
+			goto error;
+
+	/* the symbol table is weak; auxiliary symbols must be kept alive */
+	for (i = 0; i < NAUXILIARIES; i++)
+		if (!simp_gcprotect(ctx, &eval.aux[i]))
+			goto error;
 #define X(s, e) if(!simp_makesymbol(ctx, &eval.aux[e], (unsigned char *)s, sizeof(s)-1)) goto error;
 	AUXILIARY_SYNTAX
 #undef  X
-	if (setjmp(eval.jmp) && !FLAG(mode, SIMP_CONTINUE))
-		goto error;
+	if (setjmp(eval.jmp)) {
+		/* drop the variables protected by the aborted evaluation */
+		simp_gcsetroots(ctx, nroots + LEN(gcignore) + NAUXILIARIES);
+		eval.sp = eval.nwords = eval.nconsts = 0;
+		if (!FLAG(mode, SIMP_CONTINUE))
+			goto error;
+	}
 	for (;;) {
-		simp_gc(ctx, gcignore, LEN(gcignore));
+		if (simp_gcneeded(ctx))
+			simp_gc(ctx, gcignore, LEN(gcignore));
 		if (simp_porterr(rport))
 			goto error;
 		if (mode & SIMP_PROMPT)
@@ -2295,6 +3828,11 @@ simp_repl(Simp ctx, Simp env, Simp rport, Simp iport, Simp oport, Simp eport, in
 	}
 	retval = true;
 error:
-	simp_gc(ctx, gcignore, LEN(gcignore));
+	free(eval.stack);
+	free(eval.words);
+	free(eval.consts);
+	simp_gcsetroots(ctx, nroots);
+	if (simp_gcneeded(ctx))
+		simp_gc(ctx, gcignore, LEN(gcignore));
 	return retval;
 }
@@ -0,0 +1,62 @@
+# Exercise the garbage collector: build old data, churn young data
+# through it, and check that nothing live was lost along the way.
+
+(defun build n acc
+  (if (= n 0)
+    acc
+    (build (- n 1) (vector n acc))))
+
+(defun sum l acc
+  (if (null? l)
+    acc
+    (sum (get l 1) (+ acc (get l 0)))))
+
+(define big (build 50000 \()))
+(define keep (vector 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0))
+
+# store young vectors into an old one, so the write barrier is needed
+(defun churn n
+  (if (= n 0)
+    0
+    (do
+      (set! keep (remainder n 16)
+        (vector n (string-concat "x" "y") (get keep (remainder (+ n 1) 16))))
+      (churn (- n 1)))))
+
+(defun depth v acc
+  (if (vector? v)
+    (depth (get v 2) (+ acc 1))
+    acc))
+
+(churn 200000)
+(display (sum big 0))
+(newline)
+(display (get (get keep 3) 0))
+(newline)
+(display (depth (get keep 0) 0))
+(newline)
+
+# likewise into a large one, whose slots are remembered one by one
+(define table (alloc 4096))
+
+(defun scatter n
+  (if (= n 0)
+    0
+    (do
+      (set! table (remainder (* n 7919) 4096) (vector n))
+      (scatter (- n 1)))))
+
+(defun total i acc
+  (if (= i 4096)
+    acc
+    (total (+ i 1) (+ acc (get (get table i) 0)))))
+
+(scatter 100000)
+(display (total 0 0))
+(newline)
+
+(define stats (runtime-stats))
+(display (get (get stats 0) 0))
+(newline)
+(display (> (get (get stats 1) 1) 0))
+(newline)
@@ -0,0 +1,57 @@
+#!/bin/sh
+#
+# Run gc.lisp under several collector settings and compare its output
+# against gc.out.  Also check that SIMP_STATS dumps every statistic,
+# and that major collections get to finish.
+#
+# usage: gc.sh [simp]
+
+simp="${1:-./simp}"
+dir="$(dirname "$0")"
+tmp="${TMPDIR:-/tmp}/simp-gc.$$"
+status=0
+
+trap 'rm -f "$tmp.out" "$tmp.json"' EXIT
+
+# usage: run flags [name=value ...]
+run() {
+	flags="$1"
+	shift
+	what="$(echo $flags "$@")"
+	if ! env "$@" SIMP_STATS="$tmp.json" "$simp" $flags "$dir/gc.lisp" >"$tmp.out" ||
+	   ! cmp -s "$tmp.out" "$dir/gc.out"; then
+		echo "gc.sh: ${what:-defaults}: unexpected output" >&2
+		status=1
+		return
+	fi
+	for key in evaluations collections minor-collections major-collections \
+	           increments pause-total pause-max allocated-bytes \
+	           allocated-objects live-bytes live-objects environments \
+	           symbols symbol-buckets symbol-bucket-max pauses \
+	           symbol-bucket-loads allocations; do
+		if ! grep -q "^  \"$key\": " "$tmp.json"; then
+			echo "gc.sh: ${what:-defaults}: missing statistic: $key" >&2
+			status=1
+		fi
+	done
+}
+
+# usage: major flags [name=value ...]
+major() {
+	run "$@"
+	if ! grep -q '^  "major-collections": [1-9]' "$tmp.json"; then
+		echo "gc.sh: ${what:-defaults}: no major collection finished" >&2
+		status=1
+	fi
+}
+
+major ""                                # default settings
+major "" SIMP_GCBUDGET=0                # stop-the-world collections
+major "" SIMP_GCBUDGET=1                # increments paced by allocation
+major "" SIMP_GCBUDGET=1048576          # few large increments
+major "" SIMP_GCTHREADS=1               # no marking or sweeping workers
+major "" SIMP_GCTHREADS=4               # parallel marking and sweeping
+major "" SIMP_GCGROWTH=1 SIMP_GCMINHEAP=0 # collect as often as possible
+run "-g 8 -m 67108864"                  # collect as rarely as possible
+major "-s -g 1.5 -m 65536"              # no source locations
+exit $status
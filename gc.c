@@ -1,170 +1,1882 @@
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "simp.h"
 
+/*
+ * Minimum number of bytes allocated between collections, and minimum
+ * size of the old generation before a major collection.
+ */
+#define GC_MINHEAP      (1 << 22)
+
+/*
+ * Factor by which the heap may grow after a collection before the next
+ * one: the bytes that survived a collection, times the factor minus one,
+ * can be allocated before a minor collection (but see GC_NURSERY); and
+ * the old generation can grow to the bytes that survived a major
+ * collection times the factor before the next major collection.
+ */
+#define GC_GROWTH       2.0
+
+/* initial size of the stack of protected objects and remembered set */
+#define ROOTS_SIZE      64
+
+/* number of bytes allocated between increments of a major collection */
+#define GC_STEP         (1 << 16)
+
+/* number of slots traversed by an increment of a major collection */
+#define GC_BUDGET       (1 << 12)
+
+/*
+ * Maximum number of bytes allocated between minor collections when
+ * collecting incrementally, so the pause of a minor collection does
+ * not grow with the heap.
+ */
+#define GC_NURSERY      (1 << 19)
+
+/*
+ * Maximum number of slots of old objects remembered between minor
+ * collections when collecting incrementally, so the pause of a minor
+ * collection does not grow with the writes into old objects either.
+ */
+#define GC_DIRTY        (1 << 11)
+
+/* initial size of the stack of objects to be traversed */
+#define STACK_SIZE      1024
+
+/* maximum number of threads marking and sweeping in parallel */
+#define MAX_THREADS     8
+
+/* number of pages from which marking and sweeping are done in parallel */
+#define PARALLEL_PAGES  256
+
+/* number of objects in the deque of a marking thread */
+#define DEQUE_SIZE      (1 << 16)
+
+/* number of pages a sweeping thread takes at a time */
+#define SWEEP_CHUNK     16
+
+/* size (and alignment) of a page of objects */
+#define POOL_SIZE       (1 << 16)
+
+/*
+ * Payloads up to SMALL_SIZE bytes are rounded up to a multiple of
+ * GRANULE; payloads up to LARGE_SIZE bytes are rounded up to a power
+ * of two.  Each of those sizes is a class, and objects of a class are
+ * allocated from pages holding only objects of that class.  Larger
+ * payloads get a page of their own.
+ */
+#define GRANULE         16
+#define SMALL_SIZE      256
+#define LARGE_SIZE      8192
+#define NCLASSES        (SMALL_SIZE / GRANULE + 5)
+
+#define ROUNDUP(n, m)   (((n) + (m) - 1) / (m) * (m))
+#define HEAPHEAD        ROUNDUP(sizeof(Heap), GRANULE)
+#define PAGEHEAD        ROUNDUP(sizeof(Page), GRANULE)
+#define PAGEOF(heap)    ((Page *)((uintptr_t)(heap) & ~(uintptr_t)(POOL_SIZE - 1)))
+#define HEAPDATA(heap)  ((void *)((unsigned char *)(heap) + HEAPHEAD))
+#define NEXTFREE(heap)  (*(Heap **)HEAPDATA(heap))
+#define SLOT(page, i)   ((Heap *)((unsigned char *)(page) + PAGEHEAD + (i) * (page)->slotsize))
+
+/* bitmaps of the slots of a page */
+#define MAXSLOTS        (POOL_SIZE / (HEAPHEAD + GRANULE))
+#define WORDBITS        (sizeof(Bitmap) * CHAR_BIT)
+#define NWORDS(n)       (((n) + WORDBITS - 1) / WORDBITS)
+#define GETBIT(map, i)  (((map)[(i) / WORDBITS] >> ((i) % WORDBITS)) & 1)
+#define SETBIT(map, i)  ((map)[(i) / WORDBITS] |= (Bitmap)1 << ((i) % WORDBITS))
+#define CLRBIT(map, i)  ((map)[(i) / WORDBITS] &= ~((Bitmap)1 << ((i) % WORDBITS)))
+
+/*
+ * Fetch the payload of an object which is going to be traversed.
+ *
+ * Marking threads need atomic operations, which are only available as
+ * compiler builtins in C99; without them, the collector runs on a
+ * single thread.
+ */
+#ifdef __GNUC__
+#define PREFETCH(p)     __builtin_prefetch(p)
+#define LOAD(p)         __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define FETCHADD(p, v)  __atomic_fetch_add((p), (v), __ATOMIC_SEQ_CST)
+#define FETCHOR(p, v)   __atomic_fetch_or((p), (v), __ATOMIC_RELAXED)
+#define CAS(p, o, n)    __atomic_compare_exchange_n((p), &(o), (n), false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)
+#define FENCE()         __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define NTHREADS        MAX_THREADS
+#else
+#define PREFETCH(p)     ((void)(p))
+#define LOAD(p)         (*(p))
+#define STORE(p, v)     (*(p) = (v))
+#define FETCHADD(p, v)  ((*(p) += (v)) - (v))
+#define FETCHOR(p, v)   (*(p) & (v) ? (v) : (*(p) |= (v), 0))
+#define CAS(p, o, n)    (*(p) == (o) ? (*(p) = (n), true) : false)
+#define FENCE()         ((void)0)
+#define NTHREADS        1
+#endif
+
 enum {
 	/*
-	 * Heap objects begin marked with 0.
-	 *
-	 * The garbage factor begins as 1.
-	 *
-	 * At each garbage collection run, the garbage factor switches
-	 * between 1 and -1.
-	 *
-	 * We begin with all allocated objects listed on gc->p[FREE].
-	 * Then, we mark all reachable objects with the current garbage
-	 * factor and move them to gc->p[CURR].  While we're visiting
-	 * objects, we ignore those which has already been marked.
+	 * Pages holding a single large object are not in any class.
+	 */
+	LARGE = NCLASSES,
+
+	/*
+	 * Jobs of the marking and sweeping threads.
+	 */
+	JOB_MARK,
+	JOB_SWEEP,
+	JOB_QUIT,
+};
+
+typedef unsigned long long Bitmap;
+
+/*
+ * A heap object is a header immediately followed by its payload, in
+ * a slot of a page.
+ */
+struct Heap {
+	SimpSiz         size;           /* number of objects in the payload */
+	unsigned int    slot;           /* index of the object in its page */
+	bool            remembered;
+};
+
+typedef struct Page {
+	/*
+	 * A page is an aligned block of memory beginning with this header
+	 * and followed by equally sized slots.  The header of an object
+	 * is found by masking the address of the object.
+	 */
+	struct Page    *next;           /* next page of the same class */
+	struct Page    *prev;           /* previous page of the same class */
+	struct Page    *nextfree;       /* next page with free slots */
+	struct Page    *nextyoung;      /* next page allocated from */
+	struct Collector *gc;
+	Heap           *free;           /* list of free slots */
+	SimpSiz         slotsize;
+	SimpSiz         nslots;
+	SimpSiz         nfree;
+	int             class;
+	bool            young;
+	bool            listed;         /* whether in the list of free pages */
+
+	/*
+	 * Slots of the object of a large page which have been written
+	 * a reference to a young object since the last collection (NULL
+	 * on other pages, whose objects are small enough to be traversed
+	 * whole).  The bitmap lies past the object, in the page itself.
+	 */
+	Bitmap         *dirty;
+
+	/*
+	 * Allocated slots, and marked slots.
 	 *
-	 * All allocated objects remaining on gc->p[FREE] are freed.
+	 * Objects begin unmarked, and are said to be young.  Objects
+	 * which survive a collection are marked and are said to be old.
+	 * Marks are sticky: a minor collection marks only young objects
+	 * (old objects are already marked, so they are ignored), and
+	 * frees the young objects which remain unmarked.  A major
+	 * collection clears every mark before marking, so every allocated
+	 * object is a candidate for being freed.
 	 */
-	MARK_ZERO = 0,
-	MARK_ONE  = 1,
-	MARK_MUL  = -1,
+	Bitmap          used[NWORDS(MAXSLOTS)];
+	Bitmap          marks[NWORDS(MAXSLOTS)];
+} Page;
 
+typedef struct Grey {
 	/*
-	 * Heap objects points to the previous and next objects in a
-	 * doubly linked list.
+	 * An object on the mark stack, and the first of its slots not
+	 * traversed yet; large objects are traversed a chunk at a time.
 	 */
-	PREV = 0,
-	NEXT = 1,
+	Heap           *heap;
+	SimpSiz         start;
+} Grey;
 
+typedef struct Worker {
 	/*
-	 * Garbage context is also a heap object, but instead point to
-	 * the list of garbage objects (to be freed), and the list of
-	 * reachable objects (to be kept).
+	 * A marking thread owns a deque of grey objects.  It pushes and
+	 * pops objects at the bottom of its deque, and steals objects
+	 * from the top of the deques of other threads when its own is
+	 * empty (Chase and Lev's work-stealing deque).
 	 */
-	GARBAGE = 0,
-	REACHED = 1,
-};
+	struct Collector *gc;
+	pthread_t       thread;
+	Heap          **deque;
+	long long       top;
+	long long       bottom;
+	SimpSiz         nbytes;
+	unsigned int    seed;
+	bool            overflow;
+} Worker;
 
-struct Heap {
-	struct Heap    *p[2];
-	void           *data;
-	int             mark;
-	SimpSiz         size;
-};
+typedef struct Collector {
+	/* the symbol table, in a large page of its own */
+	Heap           *heap;
+
+	/*
+	 * Objects which have been marked but whose contents have not been
+	 * traversed yet.  If the stack could not grow, marked objects must
+	 * be traversed again once the stack is empty.
+	 */
+	Grey           *stack;
+	SimpSiz         nstack;
+	SimpSiz         maxstack;
+	bool            stackoverflow;
+
+	/*
+	 * Whether a major collection is clearing marks or marking
+	 * incrementally, and the work budget of each increment (if zero,
+	 * a major collection is done all at once).  Marks are cleared
+	 * a few pages at a time, from the page and class to clear next,
+	 * beginning at the first page of each class when the collection
+	 * began (pages allocated later have no marks to be cleared).
+	 */
+	bool            unmarking;
+	bool            marking;
+	SimpSiz         budget;
+	Page           *unmarkpage;
+	int             unmarkclass;
+	Page           *cleared[NCLASSES + 1];
+
+	/*
+	 * Threads marking and sweeping large heaps in parallel (the first
+	 * one is the calling thread).  Threads are created at the first
+	 * parallel collection and wait for a job between collections.
+	 */
+	Worker         *workers;
+	int             nthreads;
+	int             nworkers;
+	pthread_mutex_t lock;
+	pthread_cond_t  start;
+	pthread_cond_t  done;
+	unsigned long   epoch;
+	int             job;
+	int             nrunning;
+	int             nidle;
+
+	/*
+	 * Thread sweeping in the background, and the list of pages it has
+	 * swept (and number of pages it has given back) since they were
+	 * last taken back by the allocator.
+	 */
+	pthread_t       sweepthread;
+	pthread_mutex_t sweeplock;
+	pthread_cond_t  sweepcond;
+	bool            hassweeper;
+	bool            sweepbusy;
+	bool            sweepquit;
+	Page           *swept;
+	SimpSiz         nreleased;
+	SimpSiz         sweptobjs;
+	SimpSiz         sweptbytes;
+
+	/*
+	 * Pages to be swept, and the next one to be taken.  During a
+	 * major collection, pages are listed here as their marks are
+	 * cleared and as they are allocated.
+	 */
+	Page          **sweeping;
+	SimpSiz         nsweeping;
+	SimpSiz         maxsweeping;
+	SimpSiz         cursor;
+	SimpSiz         npages;
+
+	/*
+	 * Pages of each class (and large pages), and pages of each
+	 * class with free slots.
+	 */
+	Page           *pages[NCLASSES + 1];
+	Page           *free[NCLASSES];
+
+	/*
+	 * Pages which have been allocated from since the last collection;
+	 * only those may hold young objects.
+	 */
+	Page           *young;
+
+	/*
+	 * Addresses of C variables holding objects that must survive a
+	 * collection (usually the locals of the evaluator).  Objects
+	 * are reached through them at collection time, so the variable
+	 * can be reassigned while protected.
+	 */
+	Simp          **roots;
+	SimpSiz         nroots;
+	SimpSiz         maxroots;
+
+	/*
+	 * Old objects which have been written a reference to a young
+	 * object since the last collection.  A minor collection visits
+	 * them (or the dirty slots of the large ones) as if they were
+	 * roots.  If the remembered set could not grow, the next
+	 * collection must be a major one.
+	 */
+	Heap          **remembered;
+	SimpSiz         nremembered;
+	SimpSiz         maxremembered;
+	SimpSiz         ndirty;         /* slots visited by revisit() */
+	bool            overflow;
+
+	/*
+	 * Bytes allocated since the last collection, and the number of
+	 * them which triggers the next collection.
+	 */
+	SimpSiz         nbytes;
+	SimpSiz         threshold;
+
+	/* heap-growth factor and minimum heap size (see GC_GROWTH) */
+	double          growth;
+	SimpSiz         minheap;
+
+	/*
+	 * Runtime statistics; live objects are the allocated ones which
+	 * have not been freed.
+	 */
+	SimpStats       stats;
+	SimpSiz         freedobjs;
+	SimpSiz         freedbytes;
+
+	/* bytes in the old generation, and its size for a major collection */
+	SimpSiz         oldbytes;
+	SimpSiz         oldlimit;
+
+	/* bytes allocated before the current major collection began */
+	SimpSiz         majorstart;
+} Collector;
 
 static bool isheap[] = {
-#define X(n, h) [n] = h,
+#define X(n, s, h) [n] = h,
 	TYPES
 #undef  X
 };
 
-static void reach(Heap *gc, Simp obj);
+static bool
+ismarked(Heap *heap)
+{
+	return GETBIT(PAGEOF(heap)->marks, heap->slot);
+}
+
+static bool
+isyoung(Heap *heap)
+{
+	return heap != NULL && !ismarked(heap);
+}
 
 static void
-mark(Heap *gc, Heap *heap)
+mark(Collector *gc, Heap *heap)
 {
-	SimpSiz i;
+	Page *page;
+	Grey *stack;
+	SimpSiz size;
 
 	if (heap == NULL)
 		return;
-	if (heap->mark == gc->mark)
+	page = PAGEOF(heap);
+	if (GETBIT(page->marks, heap->slot))
 		return;
-	heap->mark = gc->mark;
-	if (heap->p[NEXT] != NULL)
-		heap->p[NEXT]->p[PREV] = heap->p[PREV];
-	if (heap->p[PREV] != NULL)
-		heap->p[PREV]->p[NEXT] = heap->p[NEXT];
-	else
-		gc->p[GARBAGE] = heap->p[NEXT];
-	heap->p[NEXT] = gc->p[REACHED];
-	heap->p[PREV] = NULL;
-	if (gc->p[REACHED] != NULL)
-		gc->p[REACHED]->p[PREV] = heap;
-	gc->p[REACHED] = heap;
-	for (i = 0; i < heap->size; i++) {
-		reach(gc, ((Simp *)heap->data)[i]);
+	SETBIT(page->marks, heap->slot);
+	gc->oldbytes += page->slotsize;
+	if (heap->size == 0)
+		return;
+	if (gc->nstack == gc->maxstack) {
+		size = gc->maxstack * 2;
+		if (size == 0)
+			size = STACK_SIZE;
+		stack = realloc(gc->stack, size * sizeof(*stack));
+		if (stack == NULL) {
+			gc->stackoverflow = true;
+			return;
+		}
+		gc->stack = stack;
+		gc->maxstack = size;
 	}
+	PREFETCH(HEAPDATA(heap));
+	gc->stack[gc->nstack++] = (Grey){ .heap = heap, .start = 0 };
 }
 
 static void
-reach(Heap *gc, Simp obj)
+reach(Collector *gc, Simp obj)
 {
-	mark(gc, simp_getsourcep(obj));
+	mark(gc, simp_getgcmeta(obj));
 	if (!isheap[simp_gettype(obj)])
 		return;
 	mark(gc, simp_getgcmemory(obj));
 }
 
 static void
-sweep(Heap *gc)
+scan(Collector *gc, Heap *heap, SimpSiz from, SimpSiz to)
 {
-	Heap *heap, *tmp;
+	Simp *data;
+	SimpSiz i;
 
-	heap = gc->p[GARBAGE];
-	while (heap != NULL) {
-		tmp = heap;
-		heap = heap->p[NEXT];
-		free(tmp->data);
-		free(tmp);
+	data = HEAPDATA(heap);
+	for (i = from; i < to; i++) {
+		reach(gc, data[i]);
 	}
 }
 
-void
-simp_gc(Simp ctx, Simp *objs, SimpSiz nobjs)
+static void
+traverse(Collector *gc, Heap *heap)
+{
+	scan(gc, heap, 0, heap->size);
+}
+
+static SimpSiz
+step(Collector *gc, SimpSiz budget)
+{
+	Heap *heap;
+	SimpSiz from, to;
+
+	/*
+	 * Traverse at most budget slots (all of them, if zero) of the
+	 * object on the top of the mark stack, leaving it there if it has
+	 * slots left.  The entry
+	 * is updated before traversing, as that may grow the stack.
+	 */
+	heap = gc->stack[gc->nstack - 1].heap;
+	from = gc->stack[gc->nstack - 1].start;
+	to = heap->size;
+	if (budget > 0 && to - from > budget)
+		to = from + budget;
+	if (to == heap->size)
+		gc->nstack--;
+	else
+		gc->stack[gc->nstack - 1].start = to;
+	scan(gc, heap, from, to);
+	return to - from + 1;
+}
+
+static void
+rescan(Collector *gc, Page *page)
+{
+	Heap *heap;
+	SimpSiz i;
+
+	for (i = 0; i < page->nslots; i++) {
+		if (!GETBIT(page->used, i) || !GETBIT(page->marks, i))
+			continue;
+		heap = SLOT(page, i);
+		traverse(gc, heap);
+		while (gc->nstack > 0) {
+			(void)step(gc, 0);
+		}
+	}
+}
+
+static SimpSiz
+sweep(Page *page)
+{
+	Heap *heap;
+	Bitmap dead;
+	SimpSiz i, j, n;
+
+	n = 0;
+	for (i = 0; i < NWORDS(page->nslots); i++) {
+		dead = page->used[i] & ~page->marks[i];
+		if (dead == 0)
+			continue;
+		page->used[i] &= ~dead;
+		for (j = 0; dead != 0; j++, dead >>= 1) {
+			if (!(dead & 1))
+				continue;
+			heap = SLOT(page, i * WORDBITS + j);
+			NEXTFREE(heap) = page->free;
+			page->free = heap;
+			page->nfree++;
+			n++;
+		}
+	}
+	return n;
+}
+
+static void
+freed(Collector *gc, Page *page, SimpSiz nobjs)
+{
+	gc->freedobjs += nobjs;
+	gc->freedbytes += nobjs * page->slotsize;
+}
+
+static bool
+push(Worker *w, Heap *heap)
+{
+	long long top, bottom;
+
+	bottom = w->bottom;
+	top = LOAD(&w->top);
+	if (bottom - top >= DEQUE_SIZE)
+		return false;
+	STORE(&w->deque[bottom % DEQUE_SIZE], heap);
+	STORE(&w->bottom, bottom + 1);
+	return true;
+}
+
+static Heap *
+pop(Worker *w)
+{
+	Heap *heap;
+	long long top, bottom;
+
+	bottom = w->bottom - 1;
+	STORE(&w->bottom, bottom);
+	FENCE();
+	top = LOAD(&w->top);
+	if (top > bottom) {
+		STORE(&w->bottom, bottom + 1);
+		return NULL;
+	}
+	heap = LOAD(&w->deque[bottom % DEQUE_SIZE]);
+	if (top == bottom) {
+		/* last object; race against thieves */
+		if (!CAS(&w->top, top, top + 1))
+			heap = NULL;
+		STORE(&w->bottom, bottom + 1);
+	}
+	return heap;
+}
+
+static Heap *
+steal(Worker *w)
+{
+	Heap *heap;
+	long long top, bottom;
+
+	top = LOAD(&w->top);
+	FENCE();
+	bottom = LOAD(&w->bottom);
+	if (top >= bottom)
+		return NULL;
+	heap = LOAD(&w->deque[top % DEQUE_SIZE]);
+	if (!CAS(&w->top, top, top + 1))
+		return NULL;
+	return heap;
+}
+
+static void
+parmark(Worker *w, Heap *heap)
+{
+	Page *page;
+	Bitmap bit;
+
+	if (heap == NULL)
+		return;
+	page = PAGEOF(heap);
+	bit = (Bitmap)1 << (heap->slot % WORDBITS);
+	if (FETCHOR(&page->marks[heap->slot / WORDBITS], bit) & bit)
+		return;
+	w->nbytes += page->slotsize;
+	if (heap->size == 0)
+		return;
+	PREFETCH(HEAPDATA(heap));
+	if (!push(w, heap)) {
+		/* found again when rescanning */
+		w->overflow = true;
+	}
+}
+
+static void
+partraverse(Worker *w, Heap *heap)
+{
+	Simp *data;
+	SimpSiz i;
+
+	data = HEAPDATA(heap);
+	for (i = 0; i < heap->size; i++) {
+		parmark(w, simp_getgcmeta(data[i]));
+		if (isheap[simp_gettype(data[i])]) {
+			parmark(w, simp_getgcmemory(data[i]));
+		}
+	}
+}
+
+static Heap *
+thieve(Worker *w)
+{
+	Collector *gc = w->gc;
+	Heap *heap;
+	int i, victim;
+
+	for (i = 0; i < gc->nworkers; i++) {
+		w->seed = w->seed * 1103515245 + 12345;
+		victim = (w->seed >> 16) % gc->nworkers;
+		if (&gc->workers[victim] == w)
+			continue;
+		if ((heap = steal(&gc->workers[victim])) != NULL) {
+			return heap;
+		}
+	}
+	return NULL;
+}
+
+static bool
+haswork(Collector *gc)
+{
+	int i;
+
+	for (i = 0; i < gc->nworkers; i++)
+		if (LOAD(&gc->workers[i].top) < LOAD(&gc->workers[i].bottom))
+			return true;
+	return false;
+}
+
+static void
+markjob(Worker *w)
+{
+	Collector *gc = w->gc;
+	Heap *heap;
+
+	/*
+	 * A thread with nothing to pop nor to steal becomes idle.  Idle
+	 * threads hold no grey object, so marking is over once every
+	 * thread is idle.
+	 */
+	for (;;) {
+		while ((heap = pop(w)) != NULL)
+			partraverse(w, heap);
+		if ((heap = thieve(w)) != NULL) {
+			partraverse(w, heap);
+			continue;
+		}
+		FETCHADD(&gc->nidle, 1);
+		for (;;) {
+			if (LOAD(&gc->nidle) == gc->nworkers)
+				return;
+			if (haswork(gc)) {
+				FETCHADD(&gc->nidle, -1);
+				break;
+			}
+			(void)sched_yield();
+		}
+	}
+}
+
+static void
+sweepchunks(Collector *gc)
+{
+	Page *page;
+	SimpSiz i, j, k, n, nobjs, nbytes;
+
+	/*
+	 * Sweep chunks of pages and hand them back to the allocator,
+	 * giving back the pages which became empty.
+	 */
+	while ((i = FETCHADD(&gc->cursor, SWEEP_CHUNK)) < gc->nsweeping) {
+		n = gc->nsweeping - i;
+		if (n > SWEEP_CHUNK)
+			n = SWEEP_CHUNK;
+		nobjs = nbytes = 0;
+		for (j = i; j < i + n; j++) {
+			page = gc->sweeping[j];
+			k = sweep(page);
+			nobjs += k;
+			nbytes += k * page->slotsize;
+		}
+		(void)pthread_mutex_lock(&gc->sweeplock);
+		gc->sweptobjs += nobjs;
+		gc->sweptbytes += nbytes;
+		for (j = i; j < i + n; j++) {
+			page = gc->sweeping[j];
+			if (page->nfree == page->nslots) {
+				free(page);
+				gc->nreleased++;
+			} else {
+				page->next = gc->swept;
+				gc->swept = page;
+			}
+		}
+		(void)pthread_mutex_unlock(&gc->sweeplock);
+	}
+}
+
+static void
+sweepjob(Worker *w)
+{
+	sweepchunks(w->gc);
+}
+
+static void *
+sweeper(void *arg)
+{
+	Collector *gc = arg;
+
+	(void)pthread_mutex_lock(&gc->sweeplock);
+	for (;;) {
+		while (!gc->sweepbusy && !gc->sweepquit)
+			(void)pthread_cond_wait(&gc->sweepcond, &gc->sweeplock);
+		if (gc->sweepquit)
+			break;
+		(void)pthread_mutex_unlock(&gc->sweeplock);
+		sweepchunks(gc);
+		(void)pthread_mutex_lock(&gc->sweeplock);
+		gc->sweepbusy = false;
+		(void)pthread_cond_broadcast(&gc->sweepcond);
+	}
+	(void)pthread_mutex_unlock(&gc->sweeplock);
+	return NULL;
+}
+
+static void
+dojob(Worker *w, int job)
+{
+	switch (job) {
+	case JOB_MARK:
+		markjob(w);
+		break;
+	case JOB_SWEEP:
+		sweepjob(w);
+		break;
+	}
+}
+
+static void *
+worker(void *arg)
+{
+	Worker *w = arg;
+	Collector *gc = w->gc;
+	unsigned long epoch = 0;
+	int job;
+
+	for (;;) {
+		(void)pthread_mutex_lock(&gc->lock);
+		while (gc->epoch == epoch)
+			(void)pthread_cond_wait(&gc->start, &gc->lock);
+		epoch = gc->epoch;
+		job = gc->job;
+		(void)pthread_mutex_unlock(&gc->lock);
+		if (job == JOB_QUIT)
+			return NULL;
+		dojob(w, job);
+		(void)pthread_mutex_lock(&gc->lock);
+		if (--gc->nrunning == 0)
+			(void)pthread_cond_signal(&gc->done);
+		(void)pthread_mutex_unlock(&gc->lock);
+	}
+}
+
+static bool
+spawn(Collector *gc)
+{
+	int i;
+
+	if (gc->nworkers > 0)
+		return gc->nworkers > 1;
+	if (gc->nthreads < 2)
+		return false;
+	gc->workers = calloc(gc->nthreads, sizeof(*gc->workers));
+	if (gc->workers == NULL)
+		return false;
+	for (i = 0; i < gc->nthreads; i++) {
+		gc->workers[i].gc = gc;
+		gc->workers[i].seed = i;
+		gc->workers[i].deque = malloc(DEQUE_SIZE * sizeof(Heap *));
+		if (gc->workers[i].deque == NULL)
+			break;
+		if (i > 0 && pthread_create(&gc->workers[i].thread, NULL, worker, &gc->workers[i]) != 0) {
+			free(gc->workers[i].deque);
+			break;
+		}
+	}
+	gc->nworkers = i;
+	return gc->nworkers > 1;
+}
+
+static void
+post(Collector *gc, int job)
+{
+	(void)pthread_mutex_lock(&gc->lock);
+	gc->job = job;
+	gc->epoch++;
+	gc->nrunning = gc->nworkers - 1;
+	(void)pthread_cond_broadcast(&gc->start);
+	(void)pthread_mutex_unlock(&gc->lock);
+}
+
+static void
+run(Collector *gc, int job)
+{
+	post(gc, job);
+	dojob(&gc->workers[0], job);
+	(void)pthread_mutex_lock(&gc->lock);
+	while (gc->nrunning > 0)
+		(void)pthread_cond_wait(&gc->done, &gc->lock);
+	(void)pthread_mutex_unlock(&gc->lock);
+}
+
+static bool
+idle(Collector *gc)
+{
+	bool idle;
+
+	/* the threads may still be sweeping in the background */
+	(void)pthread_mutex_lock(&gc->lock);
+	idle = gc->nrunning == 0;
+	(void)pthread_mutex_unlock(&gc->lock);
+	return idle;
+}
+
+static bool
+isparallel(Collector *gc)
+{
+	return gc->npages >= PARALLEL_PAGES && spawn(gc) && idle(gc);
+}
+
+static void
+parallel(Collector *gc)
+{
+	Worker *w;
+	int i;
+
+	/*
+	 * Deal the grey objects among the deques; those which do not fit,
+	 * and those partly traversed, remain on the mark stack.
+	 */
+	for (i = 0; gc->nstack > 0; i = (i + 1) % gc->nworkers) {
+		if (gc->stack[gc->nstack - 1].start > 0)
+			break;
+		if (!push(&gc->workers[i], gc->stack[gc->nstack - 1].heap))
+			break;
+		gc->nstack--;
+	}
+	gc->nidle = 0;
+	run(gc, JOB_MARK);
+	for (i = 0; i < gc->nworkers; i++) {
+		w = &gc->workers[i];
+		gc->oldbytes += w->nbytes;
+		if (w->overflow)
+			gc->stackoverflow = true;
+		w->nbytes = 0;
+		w->overflow = false;
+	}
+}
+
+static void
+propagate(Collector *gc)
+{
+	Page *page;
+	int class;
+
+	/*
+	 * Traverse marked objects until there is no object left to be
+	 * traversed.  Objects whose traversal was lost on a stack
+	 * overflow are found again by traversing every marked object.
+	 */
+	for (;;) {
+		if (gc->nstack > 0 && isparallel(gc))
+			parallel(gc);
+		while (gc->nstack > 0)
+			(void)step(gc, 0);
+		if (!gc->stackoverflow)
+			break;
+		gc->stackoverflow = false;
+		rescan(gc, PAGEOF(gc->heap));
+		for (class = 0; class <= LARGE; class++) {
+			for (page = gc->pages[class]; page != NULL; page = page->next) {
+				rescan(gc, page);
+			}
+		}
+	}
+}
+
+static void
+attach(Collector *gc, Page *page)
+{
+	page->prev = NULL;
+	page->next = gc->pages[page->class];
+	if (page->next != NULL)
+		page->next->prev = page;
+	gc->pages[page->class] = page;
+}
+
+static void
+detach(Collector *gc, Page *page)
+{
+	if (page->prev != NULL)
+		page->prev->next = page->next;
+	else
+		gc->pages[page->class] = page->next;
+	if (page->next != NULL)
+		page->next->prev = page->prev;
+}
+
+static void
+enlist(Collector *gc, Page *page)
+{
+	page->listed = page->nfree > 0 && page->class < LARGE;
+	if (!page->listed)
+		return;
+	page->nextfree = gc->free[page->class];
+	gc->free[page->class] = page;
+}
+
+static void
+release(Collector *gc)
+{
+	Page *page, *next;
+	int class;
+
+	/*
+	 * Give back pages which became empty, and rebuild the lists of
+	 * pages with free slots.
+	 */
+	for (class = 0; class <= LARGE; class++) {
+		if (class < LARGE)
+			gc->free[class] = NULL;
+		for (page = gc->pages[class]; page != NULL; page = next) {
+			next = page->next;
+			if (page->nfree == page->nslots) {
+				detach(gc, page);
+				free(page);
+				gc->npages--;
+				continue;
+			}
+			enlist(gc, page);
+		}
+	}
+}
+
+static void
+recycle(Collector *gc)
+{
+	Page *page, *next;
+
+	/*
+	 * Only the pages allocated from since the last collection may
+	 * have had objects freed by a minor collection, so the other
+	 * pages are not visited.  Pages which became empty are given
+	 * back, unless they are in the list of pages with free slots
+	 * (they are allocated from next, then).
+	 */
+	for (page = gc->young; page != NULL; page = next) {
+		next = page->nextyoung;
+		page->young = false;
+		if (page->listed)
+			continue;
+		if (page->nfree == page->nslots) {
+			detach(gc, page);
+			free(page);
+			gc->npages--;
+			continue;
+		}
+		enlist(gc, page);
+	}
+	gc->young = NULL;
+}
+
+static void
+forget(Collector *gc)
+{
+	Page *page;
+	SimpSiz i;
+
+	for (i = 0; i < gc->nremembered; i++) {
+		gc->remembered[i]->remembered = false;
+		page = PAGEOF(gc->remembered[i]);
+		if (page->dirty != NULL) {
+			memset(page->dirty, 0, NWORDS(gc->remembered[i]->size) * sizeof(Bitmap));
+		}
+	}
+	gc->nremembered = 0;
+	gc->ndirty = 0;
+	gc->overflow = false;
+}
+
+static void
+shade(Collector *gc, Simp *objs, SimpSiz nobjs)
 {
-	Heap *gc = simp_getgcmemory(ctx);
 	SimpSiz i;
 
-	gc->p[GARBAGE] = gc->p[REACHED];
-	gc->p[REACHED] = NULL;
 	for (i = 0; i < nobjs; i++)
 		reach(gc, objs[i]);
-	for (i = 0; i < gc->size; i++)
-		reach(gc, ((Simp *)gc->data)[i]);
-	sweep(gc);
-	gc->mark *= MARK_MUL;
-	gc->p[GARBAGE] = NULL;
+	for (i = 0; i < gc->nroots; i++)
+		reach(gc, *gc->roots[i]);
+}
+
+static void
+revisit(Collector *gc, Heap *heap)
+{
+	Page *page;
+	Simp *data;
+	Bitmap dirty;
+	SimpSiz i, j;
+
+	/*
+	 * Traverse a remembered object; only the dirty slots of a large
+	 * object are traversed, so a write into a large old vector does
+	 * not cost a traversal of the whole vector.
+	 */
+	page = PAGEOF(heap);
+	if (page->dirty == NULL) {
+		traverse(gc, heap);
+		return;
+	}
+	data = HEAPDATA(heap);
+	for (i = 0; i < NWORDS(heap->size); i++) {
+		for (dirty = page->dirty[i], j = 0; dirty != 0; j++, dirty >>= 1) {
+			if (dirty & 1) {
+				reach(gc, data[i * WORDBITS + j]);
+			}
+		}
+	}
+}
+
+static void
+minor(Collector *gc, Simp *objs, SimpSiz nobjs)
+{
+	Page *page;
+	SimpSiz i;
+
+	/*
+	 * Old objects are not traversed, except for the old objects in
+	 * the remembered set.  Survivors are promoted into the old
+	 * generation by being marked.
+	 */
+	shade(gc, objs, nobjs);
+	for (i = 0; i < gc->nremembered; i++)
+		revisit(gc, gc->remembered[i]);
+	propagate(gc);
+	simp_contextprune(gc->heap, ismarked, false);
+	for (page = gc->young; page != NULL; page = page->nextyoung) {
+		freed(gc, page, sweep(page));
+	}
+}
+
+static void
+unmark(Page *page)
+{
+	SimpSiz i;
+
+	for (i = 0; i < NWORDS(page->nslots); i++) {
+		page->marks[i] = 0;
+	}
+}
+
+static bool
+reserve(Collector *gc)
+{
+	Page **sweeping;
+	SimpSiz size;
+
+	/* make room in the array of pages to be swept for every page */
+	if (gc->maxsweeping >= gc->npages)
+		return true;
+	size = gc->maxsweeping * 2;
+	if (size < gc->npages)
+		size = gc->npages;
+	sweeping = realloc(gc->sweeping, size * sizeof(*sweeping));
+	if (sweeping == NULL)
+		return false;
+	gc->sweeping = sweeping;
+	gc->maxsweeping = size;
+	return true;
+}
+
+static bool
+background(Collector *gc)
+{
+	int class;
+
+	/*
+	 * Pages are detached from the allocator and swept by the sweeping
+	 * thread (helped by the marking threads on large heaps) while the
+	 * evaluation goes on.  Pages are independent of each other, so
+	 * threads sweep chunks of pages taken from an array of every page,
+	 * and the allocator takes swept pages back as it needs them.  The
+	 * array was filled as marks were cleared and pages were allocated,
+	 * so pages are not visited here (unless some could not be listed).
+	 */
+	if (!gc->hassweeper) {
+		if (pthread_create(&gc->sweepthread, NULL, sweeper, gc) != 0)
+			return false;
+		gc->hassweeper = true;
+	}
+	if (gc->nsweeping != gc->npages)
+		return false;
+	for (class = 0; class <= LARGE; class++) {
+		gc->pages[class] = NULL;
+		if (class < LARGE) {
+			gc->free[class] = NULL;
+		}
+	}
+	gc->cursor = 0;
+	(void)pthread_mutex_lock(&gc->sweeplock);
+	gc->sweepbusy = true;
+	(void)pthread_cond_broadcast(&gc->sweepcond);
+	(void)pthread_mutex_unlock(&gc->sweeplock);
+	if (isparallel(gc))
+		post(gc, JOB_SWEEP);
+	return true;
+}
+
+static void
+adopt(Collector *gc)
+{
+	Page *page, *next;
+
+	(void)pthread_mutex_lock(&gc->sweeplock);
+	page = gc->swept;
+	gc->swept = NULL;
+	gc->npages -= gc->nreleased;
+	gc->nreleased = 0;
+	gc->freedobjs += gc->sweptobjs;
+	gc->freedbytes += gc->sweptbytes;
+	gc->sweptobjs = gc->sweptbytes = 0;
+	(void)pthread_mutex_unlock(&gc->sweeplock);
+	for (; page != NULL; page = next) {
+		next = page->next;
+		attach(gc, page);
+		enlist(gc, page);
+	}
+}
+
+static bool
+swept(Collector *gc)
+{
+	bool busy;
+
+	/* whether the background sweeping is over */
+	if (!gc->hassweeper)
+		return true;
+	(void)pthread_mutex_lock(&gc->sweeplock);
+	busy = gc->sweepbusy;
+	(void)pthread_mutex_unlock(&gc->sweeplock);
+	return !busy && idle(gc);
+}
+
+static void
+settle(Collector *gc)
+{
+	/*
+	 * Wait for the background sweeping to finish, and take back the
+	 * swept pages.
+	 */
+	if (gc->hassweeper) {
+		(void)pthread_mutex_lock(&gc->sweeplock);
+		while (gc->sweepbusy)
+			(void)pthread_cond_wait(&gc->sweepcond, &gc->sweeplock);
+		(void)pthread_mutex_unlock(&gc->sweeplock);
+	}
+	if (gc->nworkers > 1) {
+		(void)pthread_mutex_lock(&gc->lock);
+		while (gc->nrunning > 0)
+			(void)pthread_cond_wait(&gc->done, &gc->lock);
+		(void)pthread_mutex_unlock(&gc->lock);
+	}
+	adopt(gc);
+}
+
+static void
+begin(Collector *gc)
+{
+	Page *page;
+	int class;
+
+	/*
+	 * A major collection begins by clearing every mark, a few pages
+	 * at each step.  Objects allocated meanwhile are white, and the
+	 * write barrier does nothing, for nothing has been traversed yet.
+	 * Every page is swept at the end of the collection, so no page is
+	 * young until then.
+	 */
+	for (page = gc->young; page != NULL; page = page->nextyoung)
+		page->young = false;
+	gc->young = NULL;
+	unmark(PAGEOF(gc->heap));
+	for (class = 0; class <= LARGE; class++)
+		gc->cleared[class] = gc->pages[class];
+	gc->unmarkclass = 0;
+	gc->unmarkpage = gc->cleared[0];
+	gc->unmarking = true;
+	gc->nsweeping = 0;
+	gc->majorstart = gc->stats.allocbytes;
+	(void)reserve(gc);
+}
+
+static void
+clear(Collector *gc, Simp *objs, SimpSiz nobjs, SimpSiz budget)
+{
+	SimpSiz work;
+
+	/*
+	 * Clear marks until the work budget (counted in bitmap words; if
+	 * zero, unlimited) runs out, listing the pages to be swept (if there is no room to
+	 * list a page, the pages are swept at once by finish()).  Once
+	 * every mark is clear, the roots are marked.  Marked objects
+	 * on the mark stack are grey, other marked objects are black,
+	 * and unmarked objects are white.
+	 */
+	for (work = 0; gc->unmarkclass <= LARGE; ) {
+		if (gc->unmarkpage == NULL) {
+			if (++gc->unmarkclass <= LARGE)
+				gc->unmarkpage = gc->cleared[gc->unmarkclass];
+			continue;
+		}
+		if (budget > 0 && work >= budget)
+			return;
+		unmark(gc->unmarkpage);
+		if (gc->nsweeping < gc->maxsweeping)
+			gc->sweeping[gc->nsweeping++] = gc->unmarkpage;
+		work += NWORDS(gc->unmarkpage->nslots);
+		gc->unmarkpage = gc->unmarkpage->next;
+	}
+	gc->unmarking = false;
+	gc->marking = true;
+	gc->oldbytes = 0;
+	shade(gc, objs, nobjs);
+	mark(gc, gc->heap);
+}
+
+static void
+increment(Collector *gc, Simp *objs, SimpSiz nobjs, SimpSiz budget)
+{
+	SimpSiz i, work;
+
+	/*
+	 * Traverse grey objects until the work budget (counted in slots
+	 * traversed, plus one for each object) runs out; large objects
+	 * are traversed a chunk at a time, so no increment goes over the
+	 * budget.
+	 */
+	for (i = 0; i < nobjs; i++)
+		reach(gc, objs[i]);
+	for (work = 0; work < budget && gc->nstack > 0; )
+		work += step(gc, budget - work);
+}
+
+static bool
+finish(Collector *gc, Simp *objs, SimpSiz nobjs, SimpSiz budget)
+{
+	Page *page;
+	int class;
+
+	/*
+	 * The write barrier keeps the heap consistent during incremental
+	 * marking, but the roots are not barriered; so they must be
+	 * marked again before sweeping.  If that turns objects grey,
+	 * marking goes on incrementally and the roots are marked again
+	 * later.  Objects allocated while marking are black, so only
+	 * objects older than the collection can be found this way, and
+	 * there are fewer of them each time.  Without a budget, marking
+	 * is finished at once.
+	 */
+	shade(gc, objs, nobjs);
+	if (budget > 0 && gc->nstack > 0)
+		return false;
+	propagate(gc);
+	simp_contextprune(gc->heap, ismarked, true);
+	if (!background(gc)) {
+		for (class = 0; class <= LARGE; class++) {
+			for (page = gc->pages[class]; page != NULL; page = page->next) {
+				freed(gc, page, sweep(page));
+			}
+		}
+		release(gc);
+	}
+	gc->oldlimit = gc->oldbytes * gc->growth;
+	if (gc->oldlimit < gc->minheap) {
+		gc->oldlimit = gc->minheap;
+	}
+	gc->marking = false;
+	return true;
+}
+
+static void
+complete(Collector *gc, Simp *objs, SimpSiz nobjs)
+{
+	/* do what is left of a major collection at once */
+	if (gc->unmarking)
+		clear(gc, objs, nobjs, 0);
+	(void)finish(gc, objs, nobjs, 0);
+}
+
+static SimpSiz
+quota(Collector *gc)
+{
+	double owed;
+
+	/*
+	 * Work budget of the next increment of a major collection (zero
+	 * if it must be finished at once).  The collection should be over
+	 * by the time the heap grows by the growth factor again, so the
+	 * increment is given more than the budget if the evaluation
+	 * allocates too fast for it: each byte allocated pays for
+	 * traversing 1 / (growth - 1) bytes of slots.  If the collection
+	 * is still not over by then, the rest is done at once, so the
+	 * heap does not grow without bound.
+	 */
+	if (gc->budget == 0 ||
+	    gc->stats.allocbytes - gc->majorstart >= gc->oldlimit * (gc->growth - 1.0))
+		return 0;
+	owed = gc->nbytes / ((gc->growth - 1.0) * sizeof(Simp));
+	return owed > gc->budget ? owed : gc->budget;
+}
+
+static SimpSiz
+nursery(Collector *gc)
+{
+	SimpSiz size;
+
+	/* number of bytes allocated before the next minor collection */
+	size = gc->oldbytes * (gc->growth - 1.0);
+	if (size < gc->minheap)
+		size = gc->minheap;
+	if (gc->budget > 0 && size > GC_NURSERY)
+		size = GC_NURSERY;
+	return size;
+}
+
+static Collector *
+newcollector(void)
+{
+	Collector *gc;
+	long ncpus;
+	int class;
+
+	if ((gc = malloc(sizeof(*gc))) == NULL)
+		return NULL;
+	*gc = (Collector){
+		.stats = { 0 },
+		.heap = NULL,
+		.stack = NULL,
+		.nstack = 0,
+		.maxstack = 0,
+		.stackoverflow = false,
+		.unmarking = false,
+		.marking = false,
+		.budget = GC_BUDGET,
+		.unmarkpage = NULL,
+		.unmarkclass = 0,
+		.young = NULL,
+		.roots = NULL,
+		.nroots = 0,
+		.maxroots = 0,
+		.remembered = NULL,
+		.nremembered = 0,
+		.maxremembered = 0,
+		.ndirty = 0,
+		.overflow = false,
+		.nbytes = 0,
+		.threshold = GC_MINHEAP,
+		.growth = GC_GROWTH,
+		.minheap = GC_MINHEAP,
+		.oldbytes = 0,
+		.oldlimit = GC_MINHEAP,
+		.majorstart = 0,
+		.workers = NULL,
+		.nthreads = 1,
+		.nworkers = 0,
+		.epoch = 0,
+		.hassweeper = false,
+		.sweepbusy = false,
+		.sweepquit = false,
+		.swept = NULL,
+		.nreleased = 0,
+		.sweptobjs = 0,
+		.sweptbytes = 0,
+		.freedobjs = 0,
+		.freedbytes = 0,
+		.sweeping = NULL,
+		.nsweeping = 0,
+		.maxsweeping = 0,
+		.npages = 0,
+	};
+	for (class = 0; class <= LARGE; class++) {
+		gc->pages[class] = NULL;
+		if (class < LARGE) {
+			gc->free[class] = NULL;
+		}
+	}
+	gc->threshold = nursery(gc);
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus > 1)
+		gc->nthreads = ncpus < NTHREADS ? ncpus : NTHREADS;
+	if (pthread_mutex_init(&gc->lock, NULL) != 0)
+		goto error0;
+	if (pthread_cond_init(&gc->start, NULL) != 0)
+		goto error1;
+	if (pthread_cond_init(&gc->done, NULL) != 0)
+		goto error2;
+	if (pthread_mutex_init(&gc->sweeplock, NULL) != 0)
+		goto error3;
+	if (pthread_cond_init(&gc->sweepcond, NULL) != 0)
+		goto error4;
+	return gc;
+error4:
+	(void)pthread_mutex_destroy(&gc->sweeplock);
+error3:
+	(void)pthread_cond_destroy(&gc->done);
+error2:
+	(void)pthread_cond_destroy(&gc->start);
+error1:
+	(void)pthread_mutex_destroy(&gc->lock);
+error0:
+	free(gc);
+	return NULL;
+}
+
+static void
+delcollector(Collector *gc)
+{
+	int i;
+
+	if (gc->hassweeper) {
+		(void)pthread_mutex_lock(&gc->sweeplock);
+		gc->sweepquit = true;
+		(void)pthread_cond_broadcast(&gc->sweepcond);
+		(void)pthread_mutex_unlock(&gc->sweeplock);
+		(void)pthread_join(gc->sweepthread, NULL);
+	}
+	if (gc->nworkers > 1)
+		post(gc, JOB_QUIT);
+	for (i = 0; i < gc->nworkers; i++) {
+		if (i > 0)
+			(void)pthread_join(gc->workers[i].thread, NULL);
+		free(gc->workers[i].deque);
+	}
+	(void)pthread_cond_destroy(&gc->sweepcond);
+	(void)pthread_mutex_destroy(&gc->sweeplock);
+	(void)pthread_cond_destroy(&gc->done);
+	(void)pthread_cond_destroy(&gc->start);
+	(void)pthread_mutex_destroy(&gc->lock);
+	free(gc->workers);
+	free(gc->sweeping);
+	free(gc->stack);
+	free(gc->roots);
+	free(gc->remembered);
+	free(gc);
+}
+
+static void
+account(Collector *gc, struct timespec *t0)
+{
+	struct timespec t1;
+	SimpSiz ns, bound;
+	int i;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &t1);
+	ns = (t1.tv_sec - t0->tv_sec) * 1000000000 + (t1.tv_nsec - t0->tv_nsec);
+	gc->stats.pausetotal += ns;
+	if (ns > gc->stats.pausemax)
+		gc->stats.pausemax = ns;
+	bound = 1000;
+	for (i = 0; i < SIMP_NPAUSES - 1 && ns >= bound; i++)
+		bound *= 10;
+	gc->stats.pauses[i]++;
+}
+
+static Collector *
+getcollector(Heap *heap)
+{
+	return PAGEOF(heap)->gc;
+}
+
+void
+simp_gc(Simp ctx, Simp *objs, SimpSiz nobjs)
+{
+	Collector *gc = getcollector(simp_getgcmemory(ctx));
+	struct timespec t0;
+	SimpSiz work;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &t0);
+	adopt(gc);
+	if (gc->unmarking || gc->marking) {
+		gc->stats.nincrements++;
+		if ((work = quota(gc)) == 0) {
+			complete(gc, objs, nobjs);
+			gc->stats.nmajors++;
+		} else if (gc->unmarking) {
+			clear(gc, objs, nobjs, work);
+		} else if (gc->nstack > 0) {
+			increment(gc, objs, nobjs, work);
+		} else if (finish(gc, objs, nobjs, work)) {
+			gc->stats.nmajors++;
+		}
+	} else if (gc->overflow ||
+	           (gc->oldbytes >= gc->oldlimit && (gc->budget == 0 || swept(gc)))) {
+		/*
+		 * A major collection needs every page back from the
+		 * background sweeping; unless it must be done at once,
+		 * it waits for the sweeping to be over by its own.
+		 * Remembered objects may be freed by a major collection.
+		 */
+		gc->stats.nincrements++;
+		settle(gc);
+		forget(gc);
+		begin(gc);
+		if (gc->budget == 0) {
+			complete(gc, objs, nobjs);
+			gc->stats.nmajors++;
+		}
+	} else {
+		gc->stats.nminors++;
+		minor(gc, objs, nobjs);
+		forget(gc);
+	}
+	gc->nbytes = 0;
+	if (!gc->unmarking && !gc->marking) {
+		recycle(gc);
+		gc->threshold = nursery(gc);
+	}
+	account(gc, &t0);
+}
+
+SimpStats *
+simp_gcstats(Simp ctx)
+{
+	Collector *gc = getcollector(simp_getgcmemory(ctx));
+
+	adopt(gc);
+	gc->stats.ncollections = gc->stats.nminors + gc->stats.nmajors;
+	gc->stats.liveobjs = gc->stats.allocobjs - gc->freedobjs;
+	gc->stats.livebytes = gc->stats.allocbytes - gc->freedbytes;
+	gc->stats.nenvironments = gc->stats.allocs[TYPE_ENVIRONMENT];
+	simp_contextstats(ctx, &gc->stats);
+	return &gc->stats;
+}
+
+bool
+simp_gcneeded(Simp ctx)
+{
+	Collector *gc = getcollector(simp_getgcmemory(ctx));
+
+	if (gc->unmarking || gc->marking)
+		return gc->nbytes >= GC_STEP;
+	if (gc->budget > 0 && gc->ndirty >= GC_DIRTY)
+		return true;
+	return gc->nbytes >= gc->threshold;
+}
+
+void
+simp_gcsetgrowth(Simp ctx, double growth)
+{
+	Collector *gc = getcollector(simp_getgcmemory(ctx));
+
+	if (growth < 1.0)
+		growth = 1.0;
+	gc->growth = growth;
+}
+
+void
+simp_gcsetminheap(Simp ctx, SimpSiz minheap)
+{
+	Collector *gc = getcollector(simp_getgcmemory(ctx));
+
+	/* takes effect from the next collection on */
+	gc->minheap = minheap;
+	gc->threshold = nursery(gc);
+	gc->oldlimit = minheap;
+}
+
+void
+simp_gcsetbudget(Simp ctx, SimpSiz budget)
+{
+	Collector *gc = getcollector(simp_getgcmemory(ctx));
+
+	gc->budget = budget;
+	gc->threshold = nursery(gc);
+}
+
+void
+simp_gcsetthreads(Simp ctx, SimpSiz nthreads)
+{
+	Collector *gc = getcollector(simp_getgcmemory(ctx));
+
+	/* threads are created at the first parallel collection */
+	if (gc->nworkers > 0)
+		return;
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > NTHREADS)
+		nthreads = NTHREADS;
+	gc->nthreads = nthreads;
+}
+
+void
+simp_gcbarrier(Simp ctx, Simp obj, SimpSiz pos, Simp val)
+{
+	Collector *gc;
+	Page *page;
+	Heap *heap, **remembered;
+	SimpSiz size, slot;
+
+	/*
+	 * During incremental marking, the value written is shaded grey,
+	 * so no black object ever points to a white one.
+	 */
+	gc = getcollector(simp_getgcmemory(ctx));
+	if (gc->marking) {
+		reach(gc, val);
+		return;
+	}
+	if (gc->unmarking)
+		return;
+
+	/*
+	 * Otherwise, only a reference from an old object to a young one
+	 * must be remembered; young objects are always visited by the
+	 * next collection.  On a large object, the slot written into is
+	 * remembered too.
+	 */
+	heap = simp_getgcmemory(obj);
+	if (heap == NULL || !ismarked(heap))
+		return;
+	if (!isyoung(simp_getgcmeta(val)) &&
+	    !(isheap[simp_gettype(val)] && isyoung(simp_getgcmemory(val))))
+		return;
+	page = PAGEOF(heap);
+	if (!heap->remembered) {
+		if (gc->nremembered == gc->maxremembered) {
+			size = gc->maxremembered * 2;
+			if (size == 0)
+				size = ROOTS_SIZE;
+			remembered = realloc(gc->remembered, size * sizeof(*remembered));
+			if (remembered == NULL) {
+				gc->overflow = true;
+				return;
+			}
+			gc->remembered = remembered;
+			gc->maxremembered = size;
+		}
+		heap->remembered = true;
+		gc->remembered[gc->nremembered++] = heap;
+		if (page->dirty == NULL)
+			gc->ndirty += heap->size;
+	}
+	if (page->dirty == NULL)
+		return;
+	slot = simp_getvector(obj) + pos - (Simp *)HEAPDATA(heap);
+	if (!GETBIT(page->dirty, slot)) {
+		SETBIT(page->dirty, slot);
+		gc->ndirty++;
+	}
+}
+
+bool
+simp_gcprotect(Simp ctx, Simp *obj)
+{
+	Collector *gc;
+	Simp **roots;
+	SimpSiz size;
+
+	gc = getcollector(simp_getgcmemory(ctx));
+	if (gc->nroots == gc->maxroots) {
+		size = gc->maxroots * 2;
+		if (size == 0)
+			size = ROOTS_SIZE;
+		roots = realloc(gc->roots, size * sizeof(*roots));
+		if (roots == NULL)
+			return false;
+		gc->roots = roots;
+		gc->maxroots = size;
+	}
+	gc->roots[gc->nroots++] = obj;
+	return true;
+}
+
+SimpSiz
+simp_gcgetroots(Simp ctx)
+{
+	return getcollector(simp_getgcmemory(ctx))->nroots;
+}
+
+void
+simp_gcsetroots(Simp ctx, SimpSiz nroots)
+{
+	getcollector(simp_getgcmemory(ctx))->nroots = nroots;
 }
 
 void
 simp_gcfree(Simp ctx)
 {
-	Heap *gc = simp_getgcmemory(ctx);
+	Collector *gc = getcollector(simp_getgcmemory(ctx));
+	Page *page, *tmp;
+	int class;
 
-	gc->p[GARBAGE] = gc->p[REACHED];
-	sweep(gc);
-	free(gc->data);
-	free(gc);
+	settle(gc);
+	for (class = 0; class <= LARGE; class++) {
+		page = gc->pages[class];
+		while (page != NULL) {
+			tmp = page;
+			page = page->next;
+			free(tmp);
+		}
+	}
+	free(PAGEOF(gc->heap));
+	delcollector(gc);
 }
 
-Heap *
-simp_gcnewobj(Heap *gc, SimpSiz size, SimpSiz nobjs)
-{
-	Heap *heap = NULL;
-	void *data = NULL;
-
-	if ((heap = malloc(sizeof(*heap))) == NULL)
-		goto error;
-	if ((data = malloc(size)) == NULL)
-		goto error;
-	*heap = (Heap){
-		.mark = MARK_ZERO,
-		.p = { NULL, NULL },
-		.data = data,
-		.size = nobjs,
+static int
+classof(SimpSiz size)
+{
+	SimpSiz n;
+	int class;
+
+	if (size <= SMALL_SIZE)
+		return size == 0 ? 0 : (size - 1) / GRANULE;
+	class = SMALL_SIZE / GRANULE;
+	for (n = SMALL_SIZE * 2; n < size; n *= 2)
+		class++;
+	return size <= LARGE_SIZE ? class : LARGE;
+}
+
+static SimpSiz
+classsize(int class)
+{
+	if (class < SMALL_SIZE / GRANULE)
+		return (class + 1) * GRANULE;
+	return (SimpSiz)SMALL_SIZE << (class - SMALL_SIZE / GRANULE + 1);
+}
+
+static Page *
+newpage(Collector *gc, int class, SimpSiz size)
+{
+	Page *page;
+	Heap *heap;
+	SimpSiz slotsize, nslots, ndirty, dirty, i;
+
+	ndirty = 0;
+	if (class == LARGE) {
+		slotsize = HEAPHEAD + size;
+		nslots = 1;
+		ndirty = NWORDS(size / sizeof(Simp));
+	} else {
+		slotsize = HEAPHEAD + classsize(class);
+		nslots = (POOL_SIZE - PAGEHEAD) / slotsize;
+	}
+	dirty = ROUNDUP(PAGEHEAD + nslots * slotsize, sizeof(Bitmap));
+	if (posix_memalign((void **)&page, POOL_SIZE, dirty + ndirty * sizeof(Bitmap)) != 0)
+		return NULL;
+	*page = (Page){
+		.next = NULL,
+		.prev = NULL,
+		.nextfree = NULL,
+		.nextyoung = NULL,
+		.gc = gc,
+		.free = NULL,
+		.slotsize = slotsize,
+		.nslots = nslots,
+		.nfree = nslots,
+		.class = class,
+		.young = false,
+		.listed = false,
+		.dirty = NULL,
 	};
-	if (gc == NULL) {
+	if (class == LARGE) {
+		page->dirty = (Bitmap *)((unsigned char *)page + dirty);
+		memset(page->dirty, 0, ndirty * sizeof(Bitmap));
+	}
+	for (i = nslots; i > 0; i--) {
+		heap = (Heap *)((unsigned char *)page + PAGEHEAD + (i - 1) * slotsize);
+		heap->slot = i - 1;
+		NEXTFREE(heap) = page->free;
+		page->free = heap;
+	}
+	return page;
+}
+
+static Page *
+addpage(Collector *gc, int class, SimpSiz size)
+{
+	Page *page;
+
+	if ((page = newpage(gc, class, size)) == NULL)
+		return NULL;
+	attach(gc, page);
+	gc->npages++;
+
+	/* pages allocated during a major collection are to be swept too */
+	if ((gc->unmarking || gc->marking) && reserve(gc))
+		gc->sweeping[gc->nsweeping++] = page;
+	return page;
+}
+
+Heap *
+simp_gcnewobj(Heap *ctx, Type type, SimpSiz size, SimpSiz nobjs)
+{
+	Collector *gc;
+	Heap *heap;
+	Page *page;
+	int class;
+
+	if (ctx == NULL) {
 		/* there's no garbage context (we're creating it right now) */
-		heap->mark = MARK_ONE;
+		if ((gc = newcollector()) == NULL)
+			return NULL;
+		if ((page = newpage(gc, LARGE, size)) == NULL) {
+			delcollector(gc);
+			return NULL;
+		}
+		heap = page->free;
+		heap->size = nobjs;
+		heap->remembered = false;
+		SETBIT(page->used, heap->slot);
+		SETBIT(page->marks, heap->slot);
+		gc->heap = heap;
 		return heap;
 	}
-	heap->p[NEXT] = gc->p[REACHED];
-	if (gc->p[REACHED] != NULL)
-		gc->p[REACHED]->p[PREV] = heap;
-	gc->p[REACHED] = heap;
+	gc = getcollector(ctx);
+	class = classof(size);
+	if (class == LARGE) {
+		if ((page = addpage(gc, class, size)) == NULL)
+			return NULL;
+	} else if ((page = gc->free[class]) == NULL &&
+	           (adopt(gc), (page = gc->free[class]) == NULL)) {
+		if ((page = addpage(gc, class, size)) == NULL)
+			return NULL;
+		enlist(gc, page);
+	}
+	heap = page->free;
+	page->free = NEXTFREE(heap);
+	if (--page->nfree == 0 && class != LARGE) {
+		gc->free[class] = page->nextfree;
+		page->listed = false;
+	}
+	if (!page->young && !gc->unmarking && !gc->marking) {
+		page->young = true;
+		page->nextyoung = gc->young;
+		gc->young = page;
+	}
+	heap->size = nobjs;
+	heap->remembered = false;
+	SETBIT(page->used, heap->slot);
+	if (gc->marking) {
+		/*
+		 * Objects allocated while marking are black; what is
+		 * written into them is shaded by the write barrier.
+		 */
+		SETBIT(page->marks, heap->slot);
+		gc->oldbytes += page->slotsize;
+	} else {
+		CLRBIT(page->marks, heap->slot);
+	}
+	gc->nbytes += page->slotsize;
+	gc->stats.allocbytes += page->slotsize;
+	gc->stats.allocobjs++;
+	gc->stats.allocs[type]++;
 	return heap;
-error:
-	free(data);
-	free(heap);
-	return NULL;
 }
 
 void *
 simp_getheapdata(Heap *heap)
 {
-	return heap->data;
+	return HEAPDATA(heap);
+}
+
+SimpSiz
+simp_getheapsize(Heap *heap)
+{
+	return heap->size;
+}
+
+Heap *
+simp_getheapof(void *p)
+{
+	Page *page = PAGEOF(p);
+
+	/* the object of a size class whose payload holds an address */
+	return SLOT(page, ((unsigned char *)p - (unsigned char *)page - PAGEHEAD) / page->slotsize);
 }
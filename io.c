@@ -50,7 +50,7 @@ struct List {
 	struct List *next;
 };
 
-static bool toktoobj(Simp ctx, Simp *obj, Simp port, Token tok);
+static bool toktoobj(Simp ctx, Simp *obj, Simp port, Token tok, const char *filename);
 
 static int
 cisdecimal(int c)
@@ -503,6 +503,15 @@ cleanvector(struct List *list)
 	}
 }
 
+static bool
+locate(Simp ctx, Simp *obj, const char *filename, SimpSiz lineno, SimpSiz column)
+{
+	/* a null filename means that the location is not recorded */
+	if (filename == NULL)
+		return true;
+	return simp_setsource(ctx, obj, filename, lineno, column);
+}
+
 static bool
 fillvector(Simp ctx, Simp *vect, struct List *list, SimpSiz nitems, SimpSiz lineno, SimpSiz column, const char *filename)
 {
@@ -510,21 +519,21 @@ fillvector(Simp ctx, Simp *vect, struct List *list, SimpSiz nitems, SimpSiz line
 	SimpSiz i = 0;
 
 	if (!simp_makevector(ctx, vect, nitems) ||
-	    !simp_setsource(ctx, vect, filename, lineno, column)) {
+	    !locate(ctx, vect, filename, lineno, column)) {
 		cleanvector(list);
 		return false;
 	}
 	while (list != NULL) {
 		tmp = list;
 		list = list->next;
-		simp_setvector(*vect, i++, tmp->obj);
+		simp_setvector(ctx, *vect, i++, tmp->obj);
 		free(tmp);
 	}
 	return true;
 }
 
 static bool
-readvector(Simp ctx, Simp *vect, Simp port, SimpSiz lineno, SimpSiz column)
+readvector(Simp ctx, Simp *vect, Simp port, const char *filename, SimpSiz lineno, SimpSiz column)
 {
 	Token tok;
 	struct List *pair, *list, *last;
@@ -545,13 +554,13 @@ readvector(Simp ctx, Simp *vect, Simp port, SimpSiz lineno, SimpSiz column)
 				nitems,
 				lineno,
 				column,
-				simp_portfilename(port)
+				filename
 			);
 		default:
 			pair = malloc(sizeof(*pair));
 			if (pair == NULL)
 				goto error;
-			if (!toktoobj(ctx, &pair->obj, port, tok))
+			if (!toktoobj(ctx, &pair->obj, port, tok, filename))
 				goto error;
 			pair->next = NULL;
 			if (last == NULL)
@@ -642,39 +651,37 @@ sugar(Simp ctx, Simp *obj, Simp port, const char *str, const char *filename, Sim
 	Token tok;
 
 	if (!simp_makevector(ctx, obj, 2) ||
-	    !simp_setsource(ctx, obj, filename, lineno, column)) {
+	    !locate(ctx, obj, filename, lineno, column)) {
 		return false;
 	}
 	tok = readtok(port);
 	if (!simp_makesymbol(ctx, &quote, (unsigned char *)str, strlen(str)))
 		return false;
-	if (!toktoobj(ctx, &literal, port, tok))
+	if (!toktoobj(ctx, &literal, port, tok, filename))
 		return false;
-	simp_setvector(*obj, 0, quote);
-	simp_setvector(*obj, 1, literal);
+	simp_setvector(ctx, *obj, 0, quote);
+	simp_setvector(ctx, *obj, 1, literal);
 	return true;
 }
 
 static bool
-toktoobj(Simp ctx, Simp *obj, Simp port, Token tok)
+toktoobj(Simp ctx, Simp *obj, Simp port, Token tok, const char *filename)
 {
 	bool success;
-	const char *filename;
 	SimpSiz lineno, column;
 
-	filename = simp_portfilename(port);
 	lineno = tok.lineno;
 	column = tok.column;
 	switch (tok.type) {
 	case TOK_LPAREN:
-		return readvector(ctx, obj, port, lineno, column);
+		return readvector(ctx, obj, port, filename, lineno, column);
 	case TOK_IDENTIFIER:
 		success = simp_makesymbol(
 			ctx,
 			obj,
 			tok.u.str.str,
 			tok.u.str.len
-		) && simp_setsource(ctx, obj, filename, lineno, column);
+		) && locate(ctx, obj, filename, lineno, column);
 		free(tok.u.str.str);
 		return success;
 	case TOK_QUOTE:
@@ -713,8 +720,22 @@ simp_read(Simp ctx, Simp *obj, Simp port)
 {
 	Token tok;
 
+	simp_newsources(ctx);
 	tok = readtok(port);
-	return toktoobj(ctx, obj, port, tok);
+	return toktoobj(ctx, obj, port, tok, simp_portfilename(port));
+}
+
+bool
+simp_readdatum(Simp ctx, Simp *obj, Simp port)
+{
+	Token tok;
+
+	/*
+	 * Data read at run time are not program source, so they do not
+	 * get source locations.
+	 */
+	tok = readtok(port);
+	return toktoobj(ctx, obj, port, tok, NULL);
 }
 
 static void
@@ -795,3 +816,46 @@ simp_display(Simp port, Simp obj)
 {
 	dowrite(port, obj, true);
 }
+
+static void
+writecounts(Simp port, const char *name, SimpSiz *counts, SimpSiz ncounts)
+{
+	SimpSiz i;
+
+	simp_printf(port, ",\n  \"%s\": [", name);
+	for (i = 0; i < ncounts; i++)
+		simp_printf(port, "%s%llu", i > 0 ? ", " : "", counts[i]);
+	simp_printf(port, "]");
+}
+
+void
+simp_writestats(Simp port, SimpStats *stats)
+{
+	static const char *typenames[] = {
+#define X(n, s, h) [n] = s,
+		TYPES
+#undef  X
+	};
+	const char *sep = "";
+	SimpSiz i;
+
+	simp_printf(port, "{");
+#define X(s, f)                                                 \
+	simp_printf(port, "%s\n  \"%s\": %llu", sep, s, stats->f);  \
+	sep = ",";
+	STATS
+#undef  X
+	writecounts(port, "pauses", stats->pauses, SIMP_NPAUSES);
+	writecounts(port, "symbol-bucket-loads", stats->loads, SIMP_NLOADS);
+	simp_printf(port, ",\n  \"allocations\": {");
+	for (i = 0; i < SIMP_NTYPES; i++) {
+		simp_printf(
+			port,
+			"%s\n    \"%s\": %llu",
+			i > 0 ? "," : "",
+			typenames[i],
+			stats->allocs[i]
+		);
+	}
+	simp_printf(port, "\n  }\n}\n");
+}
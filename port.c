@@ -165,14 +165,15 @@ simp_openstream(Simp ctx, Simp *ret, const char *file, void *p, char *mode)
 	const unsigned char *filename = (const unsigned char *)file;
 
 	stream = (FILE *)p;
-	heap = simp_gcnewobj(simp_getgcmemory(ctx), sizeof(*port), 0);
+	heap = simp_gcnewobj(simp_getgcmemory(ctx), TYPE_PORT, sizeof(*port), 0);
 	if (heap == NULL)
 		return false;
 	port = (Port *)simp_getheapdata(heap);
 	port->type = PORT_STREAM;
 	port->mode = openmode(mode);
 	port->u.fp = stream;
-	if (!simp_makesymbol(ctx, &sym, filename, strlen(file) + 1))
+	if (!simp_makesymbol(ctx, &sym, filename, strlen(file) + 1) ||
+	    !simp_pinsymbol(ctx, sym))
 		return false;
 	port->filename = (const char *)simp_getsymbol(sym);
 	port->lineno = 1;
@@ -187,7 +188,7 @@ simp_openstring(Simp ctx, Simp *ret, const char *name, unsigned char *p, SimpSiz
 	Heap *heap;
 	Simp sym;
 
-	heap = simp_gcnewobj(simp_getgcmemory(ctx), sizeof(*port), 0);
+	heap = simp_gcnewobj(simp_getgcmemory(ctx), TYPE_PORT, sizeof(*port), 0);
 	if (heap == NULL)
 		return false;
 	port = (Port *)simp_getheapdata(heap);
@@ -196,7 +197,8 @@ simp_openstring(Simp ctx, Simp *ret, const char *name, unsigned char *p, SimpSiz
 	port->u.str.arr = p;
 	port->u.str.size = len;
 	port->u.str.curr = 0;
-	if (!simp_makesymbol(ctx, &sym, (unsigned char *)name, strlen(name) + 1))
+	if (!simp_makesymbol(ctx, &sym, (unsigned char *)name, strlen(name) + 1) ||
+	    !simp_pinsymbol(ctx, sym))
 		return false;
 	port->filename = (const char *)simp_getsymbol(sym);
 	port->lineno = 1;
@@ -1,4 +1,5 @@
 #include <err.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,10 +7,73 @@
 
 #include "simp.h"
 
+static SimpSiz
+tosize(const char *name, const char *s)
+{
+	SimpSiz n;
+	char *end;
+
+	errno = 0;
+	n = strtoull(s, &end, 10);
+	if (errno != 0 || end == s || *end != '\0')
+		errx(EXIT_FAILURE, "%s: invalid value: %s", name, s);
+	return n;
+}
+
+static double
+tofactor(const char *name, const char *s)
+{
+	double d;
+	char *end;
+
+	errno = 0;
+	d = strtod(s, &end);
+	if (errno != 0 || end == s || *end != '\0' || !(d >= 1.0))
+		errx(EXIT_FAILURE, "%s: invalid value: %s", name, s);
+	return d;
+}
+
+static bool
+getsize(const char *var, SimpSiz *n)
+{
+	char *s;
+
+	if ((s = getenv(var)) == NULL || *s == '\0')
+		return false;
+	*n = tosize(var, s);
+	return true;
+}
+
+static void
+dumpstats(Simp ctx, Simp eport)
+{
+	FILE *fp;
+	Simp port;
+	char *s;
+
+	if ((s = getenv("SIMP_STATS")) == NULL || *s == '\0')
+		return;
+	if (s[0] == '-' && s[1] == '\0') {
+		simp_writestats(eport, simp_gcstats(ctx));
+		return;
+	}
+	if ((fp = fopen(s, "w")) == NULL) {
+		warn("%s", s);
+		return;
+	}
+	if (simp_openstream(ctx, &port, s, fp, "w"))
+		simp_writestats(port, simp_gcstats(ctx));
+	(void)fclose(fp);
+}
+
 static void
 usage(void)
 {
-	(void)fprintf(stderr, "usage: simp [-i] [-e string | -p string | file]");
+	(void)fprintf(
+		stderr,
+		"usage: simp [-is] [-g factor] [-m size] [-e string | -p string | file]\n"
+	);
+	exit(EXIT_FAILURE);
 }
 
 int
@@ -20,22 +84,35 @@ main(int argc, char *argv[])
 	Simp ctx, env, iport, oport, eport, port;
 	int ch;
 	int iflag = 0;
+	int sflag = 0;
 	char *expr = NULL;
+	char *growth = getenv("SIMP_GCGROWTH");
+	char *minheap = getenv("SIMP_GCMINHEAP");
 	bool success = false;
+	SimpSiz n;
 
 	mode = MODE_INTERACTIVE;
-	while ((ch = getopt(argc, argv, "e:ip:")) != -1) switch (ch) {
+	while ((ch = getopt(argc, argv, "e:g:im:p:s")) != -1) switch (ch) {
 	case 'e':
 		mode = MODE_STRING;
 		expr = optarg;
 		break;
+	case 'g':
+		growth = optarg;
+		break;
 	case 'i':
 		iflag = 1;
 		break;
+	case 'm':
+		minheap = optarg;
+		break;
 	case 'p':
 		mode = MODE_PRINT;
 		expr = optarg;
 		break;
+	case 's':
+		sflag = 1;
+		break;
 	default:
 		usage();
 	}
@@ -47,6 +124,16 @@ main(int argc, char *argv[])
 	/* first, create context (holds symbol table and garbage context) */
 	if (!simp_contextnew(&ctx))
 		errx(EXIT_FAILURE, "could not create context");
+	if (sflag)
+		simp_contextsetsource(ctx, false);
+	if (getsize("SIMP_GCBUDGET", &n))
+		simp_gcsetbudget(ctx, n);
+	if (getsize("SIMP_GCTHREADS", &n))
+		simp_gcsetthreads(ctx, n);
+	if (growth != NULL && *growth != '\0')
+		simp_gcsetgrowth(ctx, tofactor("heap-growth factor", growth));
+	if (minheap != NULL && *minheap != '\0')
+		simp_gcsetminheap(ctx, tosize("minimum heap size", minheap));
 
 	/* then, create standard input/output/error ports */
 	if (!simp_openstream(ctx, &iport, "<stdin>", stdin, "r"))
@@ -104,6 +191,7 @@ interactive:
 		break;
 	}
 error:
+	dumpstats(ctx, eport);
 	simp_gcfree(ctx);
 	return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -1,4 +1,5 @@
 #include <stdbool.h>
+#include <stdint.h>
 
 #define LEN(a)          (sizeof(a) / sizeof((a)[0]))
 #define FLAG(f, b)      (((f) & (b)) == (b))
@@ -7,22 +8,46 @@
 #define RETURN_SUCCESS  0
 #define NOTHING         (-1)
 
-#define TYPES                                  \
-	/* Object type        Is allocated   */\
-	X(TYPE_VECTOR,        true            )\
-	X(TYPE_CLOSURE,       true            )\
-	X(TYPE_BUILTIN,       false           )\
-	X(TYPE_BYTE,          false           )\
-	X(TYPE_ENVIRONMENT,   true            )\
-	X(TYPE_EOF,           false           )\
-	X(TYPE_FALSE,         false           )\
-	X(TYPE_PORT,          true            )\
-	X(TYPE_REAL,          false           )\
-	X(TYPE_SIGNUM,        false           )\
-	X(TYPE_STRING,        true            )\
-	X(TYPE_SYMBOL,        true            )\
-	X(TYPE_TRUE,          false           )\
-	X(TYPE_VOID,          false           )
+#define TYPES                                                  \
+	/* Object type        Name              Is allocated   */\
+	X(TYPE_VECTOR,        "vector",         true            )\
+	X(TYPE_CLOSURE,       "closure",        true            )\
+	X(TYPE_BUILTIN,       "builtin",        false           )\
+	X(TYPE_BYTE,          "byte",           false           )\
+	X(TYPE_ENVIRONMENT,   "environment",    true            )\
+	X(TYPE_EOF,           "eof",            false           )\
+	X(TYPE_FALSE,         "false",          false           )\
+	X(TYPE_PORT,          "port",           true            )\
+	X(TYPE_REAL,          "real",           false           )\
+	X(TYPE_SIGNUM,        "signum",         false           )\
+	X(TYPE_STRING,        "string",         true            )\
+	X(TYPE_SYMBOL,        "symbol",         true            )\
+	X(TYPE_TRUE,          "true",           false           )\
+	X(TYPE_VOID,          "void",           false           )
+
+#define STATS                                                  \
+	/* Name                 Field                          */\
+	X("evaluations",        nevals                          )\
+	X("collections",        ncollections                    )\
+	X("minor-collections",  nminors                         )\
+	X("major-collections",  nmajors                         )\
+	X("increments",         nincrements                     )\
+	X("pause-total",        pausetotal                      )\
+	X("pause-max",          pausemax                        )\
+	X("allocated-bytes",    allocbytes                      )\
+	X("allocated-objects",  allocobjs                       )\
+	X("live-bytes",         livebytes                       )\
+	X("live-objects",       liveobjs                        )\
+	X("environments",       nenvironments                   )\
+	X("symbols",            nsymbols                        )\
+	X("symbol-buckets",     nbuckets                        )\
+	X("symbol-bucket-max",  maxbucket                       )
+
+/* pauses under 1us, 10us, ..., 1s, and longer */
+#define SIMP_NPAUSES    8
+
+/* symbols found in the symbol table with 1, 2, ..., 7 probes, and more */
+#define SIMP_NLOADS     8
 
 typedef struct Heap             Heap;
 typedef struct Simp             Simp;
@@ -30,6 +55,7 @@ typedef struct Port             Port;
 typedef unsigned long long      SimpSiz;
 typedef long long               SimpInt;
 typedef struct Builtin          Builtin;
+typedef struct SimpStats        SimpStats;
 
 enum {
 	SIMP_ECHO        = 0x01,
@@ -39,11 +65,28 @@ enum {
 };
 
 typedef enum Type {
-#define X(n, h) n,
+#define X(n, s, h) n,
 	TYPES
 #undef  X
 } Type;
 
+enum {
+	SIMP_NTYPES = 0
+#define X(n, s, h) + 1
+	TYPES
+#undef  X
+};
+
+struct SimpStats {
+	/* pause times are in nanoseconds */
+#define X(s, f) SimpSiz f;
+	STATS
+#undef  X
+	SimpSiz pauses[SIMP_NPAUSES];
+	SimpSiz loads[SIMP_NLOADS];
+	SimpSiz allocs[SIMP_NTYPES];
+};
+
 struct Simp {
 	union {
 		SimpInt         num;
@@ -52,16 +95,16 @@ struct Simp {
 		unsigned char   byte;
 		Builtin        *builtin;
 	} u;
-	Heap                   *meta;   /* used differently by different datatypes */
-	SimpSiz                 start;
-	SimpSiz                 size;
-	Type                    type;
+	uintptr_t               meta;   /* heap pointer used differently by different datatypes, or'ed with the type */
+	unsigned int            start;
+	unsigned int            size;
 };
 
 /* object source */
+void    simp_newsources(Simp ctx);
 bool    simp_setsource(Simp ctx, Simp *obj, const char *filename, SimpSiz lineno, SimpSiz column);
 bool    simp_getsource(Simp obj, const char **, SimpSiz *, SimpSiz *);
-Heap   *simp_getsourcep(Simp obj);
+Heap   *simp_getgcmeta(Simp obj);
 
 /* data constant utils */
 Simp    simp_nil(void);
@@ -87,9 +130,11 @@ unsigned char simp_getstringmemb(Simp obj, SimpSiz pos);
 Type    simp_gettype(Simp obj);
 Simp   *simp_getvector(Simp obj);
 Simp    simp_getclosureenv(Simp obj);
-Simp    simp_getclosureparam(Simp obj);
+Simp    simp_getclosureparams(Simp obj);
 Simp    simp_getclosurebody(Simp obj);
 Simp    simp_getclosurevarargs(Simp obj);
+Simp    simp_getclosurecode(Simp obj);
+void    simp_setclosurecode(Simp ctx, Simp obj, Simp code);
 Heap   *simp_getgcmemory(Simp obj);
 
 /* data type predicates */
@@ -123,8 +168,8 @@ bool    simp_issame(Simp a, Simp b);
 
 /* data type mutators */
 void    simp_setstring(Simp obj, SimpSiz pos, unsigned char u);
-void    simp_setvector(Simp obj, SimpSiz pos, Simp val);
-void    simp_cpyvector(Simp dst, Simp src);
+void    simp_setvector(Simp ctx, Simp obj, SimpSiz pos, Simp val);
+void    simp_cpyvector(Simp ctx, Simp dst, Simp src);
 void    simp_cpystring(Simp dst, Simp src);
 
 /* data type constructors */
@@ -158,25 +203,49 @@ void    simp_printf(Simp port, const char *fmt, ...);
 
 /* eval */
 bool    simp_read(Simp ctx, Simp *obj, Simp port);
+bool    simp_readdatum(Simp ctx, Simp *obj, Simp port);
 void    simp_write(Simp port, Simp obj);
 void    simp_display(Simp port, Simp obj);
+void    simp_writestats(Simp port, SimpStats *stats);
 bool    simp_repl(Simp, Simp, Simp, Simp, Simp, Simp, int);
 
 /* environment operations */
 bool    simp_envdefine(Simp ctx, Simp env, Simp var, Simp val, bool syntax);
-bool    simp_envredefine(Simp env, Simp var, Simp val, bool syntax);
+bool    simp_envredefine(Simp ctx, Simp env, Simp var, Simp val, bool syntax);
+bool    simp_envbind(Simp ctx, Simp env, Simp vars, const Simp *vals, SimpSiz nvals, bool variadic, SimpSiz nspare);
+bool    simp_envrebind(Simp ctx, Simp env, Simp vars, const Simp *vals, SimpSiz nvals);
 Simp    simp_getenvframe(Simp obj);
 Simp    simp_getenvsynframe(Simp obj);
 Simp    simp_getenvparent(Simp obj);
-Simp    simp_getbindvariable(Simp obj);
-Simp    simp_getbindvalue(Simp obj);
-Simp    simp_getnextbind(Simp obj);
+SimpSiz simp_getframesize(Simp frame);
+Simp    simp_getframevariable(Simp frame, SimpSiz pos);
+Simp    simp_getframevalue(Simp frame, SimpSiz pos);
+Simp   *simp_getframecell(Simp frame, SimpSiz pos);
+bool    simp_envfind(Simp env, Simp var, SimpSiz *pos);
+bool    simp_issyntax(Simp sym);
+bool    simp_islocal(Simp sym);
+bool    simp_islocalsyntax(Simp sym);
+SimpInt simp_contextversion(Simp ctx);
+SimpInt simp_contextsynversion(Simp ctx);
+Simp    simp_contextenv(Simp ctx);
 
 /* gc */
-Heap   *simp_gcnewobj(Heap *gc, SimpSiz size, SimpSiz nobjs);
+Heap   *simp_gcnewobj(Heap *gc, Type type, SimpSiz size, SimpSiz nobjs);
 void    simp_gc(Simp ctx, Simp *objs, SimpSiz nobjs);
+SimpStats *simp_gcstats(Simp ctx);
+bool    simp_gcneeded(Simp ctx);
+void    simp_gcsetbudget(Simp ctx, SimpSiz budget);
+void    simp_gcsetgrowth(Simp ctx, double growth);
+void    simp_gcsetminheap(Simp ctx, SimpSiz minheap);
+void    simp_gcsetthreads(Simp ctx, SimpSiz nthreads);
+void    simp_gcbarrier(Simp ctx, Simp obj, SimpSiz pos, Simp val);
+bool    simp_gcprotect(Simp ctx, Simp *obj);
+SimpSiz simp_gcgetroots(Simp ctx);
+void    simp_gcsetroots(Simp ctx, SimpSiz nroots);
 void    simp_gcfree(Simp ctx);
 void   *simp_getheapdata(Heap *heap);
+SimpSiz simp_getheapsize(Heap *heap);
+Heap   *simp_getheapof(void *p);
 
 /* arithmetic */
 bool    simp_arithabs(Simp ctx, Simp *ret, Simp n);
@@ -189,4 +258,8 @@ int     simp_arithcmp(Simp a, Simp b);
 
 /* context */
 bool    simp_contextnew(Simp *ctx);
+void    simp_contextsetsource(Simp ctx, bool track);
+void    simp_contextstats(Simp ctx, SimpStats *stats);
+void    simp_contextprune(Heap *ctx, bool (*isalive)(Heap *), bool major);
+bool    simp_pinsymbol(Simp ctx, Simp sym);
 bool    simp_environmentnew(Simp ctx, Simp *env);